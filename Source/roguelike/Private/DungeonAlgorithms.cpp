@@ -0,0 +1,486 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonAlgorithms.h"
+#include "DungeonGenerator.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+   // Substreams of the layouts that do not draw from the generator's main stream
+   const uint64 BspSubstream = 0x425350;
+   const uint64 DrunkardSubstream = 0x44524B;
+   const uint64 CellularSubstream = 0x43454C;
+
+   // Smallest BSP cell: a 4x4 room and a free line on every side for the corridors
+   const int32 MinCell = 6;
+
+   // Rows per task of a smoothing pass, enough work per task to hide the scheduling
+   const int32 SmoothRowsPerTask = 32;
+
+   int32 LowestBit(uint64 Bits)
+   {
+      const uint32 Low = uint32(Bits);
+      return Low ? int32(FPlatformMath::CountTrailingZeros(Low)) : 32 + int32(FPlatformMath::CountTrailingZeros(uint32(Bits >> 32)));
+   }
+}
+
+const int32 FDungeonDrunkardPolicy::CoveragePercent;
+
+void FDungeonAccretionPolicy::Layout(FDungeonGenerator& Generator)
+{
+   // Make one room in the middle to start things off.
+   Generator.MakeRoom(Generator.XSize / 2, Generator.YSize / 2, 8, 6, Generator.GetRandomDirection());
+
+   Generator.MakeFeatures(Generator.MaxFeatures - 1);
+}
+
+void FDungeonBspPolicy::Layout(FDungeonGenerator& Generator)
+{
+   Rng_ = Generator.GetSubstream(BspSubstream);
+   Rooms_.clear();
+   Features_ = 0;
+
+   // About half the features are rooms, the other half the corridors joining them.
+   const auto Area = int64(Generator.XSize - 2) * (Generator.YSize - 2);
+   TargetArea_ = int32(FMath::Min<int64>(Area * 2 / FMath::Max(Generator.MaxFeatures, 1), MAX_int32));
+
+   if (Generator.XSize - 2 >= MinCell && Generator.YSize - 2 >= MinCell)
+      Split(Generator, FIntPoint(1, 1), FIntPoint(Generator.XSize - 2, Generator.YSize - 2));
+
+   Generator.AddFeaturesPlaced(Features_);
+}
+
+void FDungeonBspPolicy::Split(FDungeonGenerator& Generator, const FIntPoint& Min, const FIntPoint& Max)
+{
+   if (Generator.IsCancelled())
+      return;
+
+   const auto Width = Max.X - Min.X + 1;
+   const auto Height = Max.Y - Min.Y + 1;
+   const bool bCanSplitX = Width >= 2 * MinCell;
+   const bool bCanSplitY = Height >= 2 * MinCell;
+
+   if ((bCanSplitX || bCanSplitY) && Width * Height > TargetArea_)
+   {
+      // Split the longer side, near squares either way.
+      bool bVertical = bCanSplitX && (!bCanSplitY || Width * 4 > Height * 5);
+      if (bCanSplitX && bCanSplitY && Width * 5 >= Height * 4 && Height * 5 >= Width * 4)
+         bVertical = Rng_.Range(0, 1) != 0;
+
+      const auto Begin = int32(Rooms_.size());
+
+      if (bVertical)
+      {
+         const auto At = Rng_.Range(Min.X + MinCell, Max.X - MinCell + 1);
+         Split(Generator, Min, FIntPoint(At - 1, Max.Y));
+         const auto Middle = int32(Rooms_.size());
+         Split(Generator, FIntPoint(At, Min.Y), Max);
+         Connect(Generator, true, At, Begin, Middle, int32(Rooms_.size()));
+      }
+      else
+      {
+         const auto At = Rng_.Range(Min.Y + MinCell, Max.Y - MinCell + 1);
+         Split(Generator, Min, FIntPoint(Max.X, At - 1));
+         const auto Middle = int32(Rooms_.size());
+         Split(Generator, FIntPoint(Min.X, At), Max);
+         Connect(Generator, false, At, Begin, Middle, int32(Rooms_.size()));
+      }
+
+      return;
+   }
+
+   // Leaf: a room of at least half the cell, one line inside the cell border.
+   const auto RoomWidth = Rng_.Range(FMath::Max(4, (Width - 2) / 2), Width - 2);
+   const auto RoomHeight = Rng_.Range(FMath::Max(4, (Height - 2) / 2), Height - 2);
+
+   FRoom Room;
+   Room.Min.X = Rng_.Range(Min.X + 1, Max.X - RoomWidth);
+   Room.Min.Y = Rng_.Range(Min.Y + 1, Max.Y - RoomHeight);
+   Room.Max = Room.Min + FIntPoint(RoomWidth - 1, RoomHeight - 1);
+   Room.Region = Generator.AddRoom(Room.Min.X, Room.Min.Y, Room.Max.X, Room.Max.Y);
+
+   Rooms_.push_back(Room);
+   ++Features_;
+}
+
+void FDungeonBspPolicy::Connect(FDungeonGenerator& Generator, bool bVertical, int32 Split, int32 Begin, int32 Middle, int32 End)
+{
+   if (Begin == Middle || Middle == End)
+      return;
+
+   // Axis U crosses the split line, V runs along it. Tiles are mapped back to x and y on the way out.
+   auto U = [bVertical](const FIntPoint& Point) { return bVertical ? Point.X : Point.Y; };
+   auto V = [bVertical](const FIntPoint& Point) { return bVertical ? Point.Y : Point.X; };
+   auto Tile = [bVertical](int32 u, int32 v) { return bVertical ? FIntPoint(u, v) : FIntPoint(v, u); };
+
+   // The rooms reaching furthest toward the split line, nothing lies between them and the line.
+   auto First = Begin;
+   for (auto i = Begin; i != Middle; ++i)
+      if (U(Rooms_[i].Max) > U(Rooms_[First].Max))
+         First = i;
+
+   auto Second = Middle;
+   for (auto i = Middle; i != End; ++i)
+      if (U(Rooms_[i].Min) < U(Rooms_[Second].Min))
+         Second = i;
+
+   const FRoom& From = Rooms_[First];
+   const FRoom& To = Rooms_[Second];
+
+   // Rooms keep off the border of their cell, so the line before the split is free in the whole cell.
+   const auto Line = Split - 1;
+   const auto vFrom = Rng_.Range(V(From.Min) + 1, V(From.Max) - 1);
+   const auto vTo = Rng_.Range(V(To.Min) + 1, V(To.Max) - 1);
+
+   auto Carve = [&Generator, &Tile](int32 u0, int32 v0, int32 u1, int32 v1)
+   {
+      const FIntPoint A = Tile(u0, v0);
+      const FIntPoint B = Tile(u1, v1);
+      return Generator.AddCorridor(FMath::Min(A.X, B.X), FMath::Min(A.Y, B.Y), FMath::Max(A.X, B.X), FMath::Max(A.Y, B.Y));
+   };
+
+   // Out of the first room to the line, along the line, then into the second room.
+   const auto Out = Carve(U(From.Max) + 1, vFrom, Line, vFrom);
+   Generator.AddDoor(Tile(U(From.Max), vFrom), From.Region, Out);
+
+   auto Along = Out;
+   if (vFrom != vTo)
+   {
+      Along = Carve(Line, vFrom, Line, vTo);
+      Generator.AddDoor(Tile(Line, vFrom), Out, Along);
+   }
+
+   const auto In = Carve(Line + 1, vTo, U(To.Min) - 1, vTo);
+   Generator.AddDoor(Tile(Line, vTo), Along, In);
+   Generator.AddDoor(Tile(U(To.Min), vTo), In, To.Region);
+
+   const FIntPoint Doors[] = { Tile(U(From.Max), vFrom), Tile(U(To.Min), vTo) };
+   for (const FIntPoint& Door : Doors)
+      Generator.SetCell(Door.X, Door.Y, ETileType::TE_Door);
+
+   ++Features_;
+}
+
+void FDungeonDrunkardPolicy::Layout(FDungeonGenerator& Generator)
+{
+   const auto XSize = Generator.XSize;
+   const auto YSize = Generator.YSize;
+
+   if (XSize < 3 || YSize < 3)
+      return;
+
+   FDungeonRng Rng = Generator.GetSubstream(DrunkardSubstream);
+
+   Floor_.Init(XSize, YSize);
+   Carved_.clear();
+
+   const auto Target = FMath::Max(int32(int64(XSize - 2) * (YSize - 2) * CoveragePercent / 100), 1);
+   const auto Walks = FMath::Max(Generator.MaxFeatures, 1);
+   const auto WalkLength = FMath::Max(Target / Walks, 1);
+
+   // The first walk starts in the middle, later ones on a random carved tile. Walks leave the border alone.
+   auto x = XSize / 2;
+   auto y = YSize / 2;
+   auto Walk = 0;
+   auto Steps = 0;
+   const int32 StepX[] = { 0, 1, 0, -1 };
+   const int32 StepY[] = { -1, 0, 1, 0 };
+
+   for (int64 Budget = int64(Target) * 32; int32(Carved_.size()) < Target && Budget > 0; --Budget)
+   {
+      if (!Floor_.Get(x, y))
+      {
+         Floor_.Set(x, y, true);
+         Carved_.push_back(x + XSize * y);
+      }
+
+      if (++Steps == WalkLength && Walk + 1 < Walks)
+      {
+         const auto Cell = Carved_[Rng.Range(0, int32(Carved_.size()) - 1)];
+         x = Cell % XSize;
+         y = Cell / XSize;
+         Steps = 0;
+         ++Walk;
+
+         if (Generator.IsCancelled())
+            break;
+      }
+
+      const auto Direction = Rng.Range(0, 3);
+      x = FMath::Clamp(x + StepX[Direction], 1, XSize - 2);
+      y = FMath::Clamp(y + StepY[Direction], 1, YSize - 2);
+   }
+
+   // Walls on every tile touching the floor, diagonals included so the cave outline has no gaps.
+   Wall_.SetSurrounding(Floor_);
+   Wall_.AndNot(Floor_);
+   Generator.SetCells(Floor_, Wall_);
+
+   FIntPoint Min(XSize, YSize);
+   FIntPoint Max(-1, -1);
+   for (const auto Cell : Carved_)
+   {
+      Min = FIntPoint(FMath::Min(Min.X, Cell % XSize), FMath::Min(Min.Y, Cell / XSize));
+      Max = FIntPoint(FMath::Max(Max.X, Cell % XSize), FMath::Max(Max.Y, Cell / XSize));
+   }
+
+   // The whole cave is a single region, it has no rooms or doors.
+   const auto Region = Generator.AddRegion(Min.X, Min.Y, Max.X, Max.Y, false);
+
+   auto& RegionId = Generator.GetLayers().RegionId;
+   if (RegionId.IsAllocated())
+      for (const auto Cell : Carved_)
+         RegionId.Set(Cell % XSize, Cell / XSize, Region);
+
+   Generator.AddFeaturesPlaced(Walk + 1);
+}
+
+void FDungeonCellularPolicy::Layout(FDungeonGenerator& Generator)
+{
+   const auto XSize = Generator.XSize;
+   const auto YSize = Generator.YSize;
+
+   if (XSize < 3 || YSize < 3)
+      return;
+
+   FDungeonRng Rng = Generator.GetSubstream(CellularSubstream);
+
+   Rock_.Init(XSize, YSize);
+   Next_.Init(XSize, YSize);
+
+   // Noise: a & (b | c | d) sets 7 of 16 bits on average, 44% rock.
+   const auto W = Rock_.GetWordsPerRow();
+   for (auto y = 0; y != YSize; ++y)
+   {
+      uint64* Row = Rock_.GetRow(y);
+
+      for (auto w = 0; w != W; ++w)
+      {
+         uint64 Words[4];
+         for (auto& Word : Words)
+            Word = (uint64(Rng.Next()) << 32) | Rng.Next();
+
+         Row[w] = Words[0] & (Words[1] | Words[2] | Words[3]);
+      }
+
+      // The map border is rock from the start, Smooth() keeps it so but may not run at all.
+      if (y == 0 || y == YSize - 1)
+         std::fill(Row, Row + W, ~uint64(0));
+
+      Row[0] |= 1;
+      Row[(XSize - 1) >> 6] |= uint64(1) << ((XSize - 1) & 63);
+      Row[W - 1] &= Rock_.TailMask();
+   }
+
+   for (auto Iteration = 0; Iteration < Generator.CaveIterations && !Generator.IsCancelled(); ++Iteration)
+      Smooth();
+
+   // Tiny maps or a high fill ratio can smooth every open tile away, the map then stays empty.
+   FIntPoint Min;
+   FIntPoint Max;
+   if (!KeepLargestCave(Min, Max))
+      return;
+
+   Wall_.SetSurrounding(Floor_);
+   Wall_.AndNot(Floor_);
+   Generator.SetCells(Floor_, Wall_);
+
+   // The cave is a single region like the one of the drunkard's walk.
+   const auto Region = Generator.AddRegion(Min.X, Min.Y, Max.X, Max.Y, false);
+
+   auto& RegionId = Generator.GetLayers().RegionId;
+   if (RegionId.IsAllocated())
+      for (auto Run = 0; Run != int32(Runs_.size()); ++Run)
+         if (FindRoot(Run) == RootOfLargest_)
+            RegionId.SetRect(Runs_[Run].xStart, Runs_[Run].y, Runs_[Run].xEnd, Runs_[Run].y, Region);
+
+   Generator.AddFeaturesPlaced(1);
+}
+
+void FDungeonCellularPolicy::Smooth()
+{
+   const auto XSize = Rock_.GetXSize();
+   const auto YSize = Rock_.GetYSize();
+   const auto W = Rock_.GetWordsPerRow();
+   const uint64 Tail = Rock_.TailMask();
+   const uint64 All = ~uint64(0);
+
+   ParallelFor((YSize + SmoothRowsPerTask - 1) / SmoothRowsPerTask, [this, XSize, YSize, W, Tail, All](int32 Task)
+   {
+      const auto yEnd = FMath::Min(YSize, (Task + 1) * SmoothRowsPerTask);
+
+      for (auto y = Task * SmoothRowsPerTask; y < yEnd; ++y)
+      {
+         uint64* Out = Next_.GetRow(y);
+
+         // The map border stays rock.
+         if (y == 0 || y == YSize - 1)
+         {
+            std::fill(Out, Out + W, All);
+            Out[W - 1] &= Tail;
+            continue;
+         }
+
+         const uint64* Up = Rock_.GetRow(y - 1);
+         const uint64* Row = Rock_.GetRow(y);
+         const uint64* Down = Rock_.GetRow(y + 1);
+
+         // Rock per column of the three rows as a two bit number, tiles past the map edge are rock.
+         auto Column = [Up, Row, Down, W, Tail](int32 w, uint64& OutLow, uint64& OutHigh)
+         {
+            const uint64 Pad = w == W - 1 ? ~Tail : 0;
+            const uint64 a = Up[w] | Pad;
+            const uint64 b = Row[w] | Pad;
+            const uint64 c = Down[w] | Pad;
+            OutLow = a ^ b ^ c;
+            OutHigh = (a & b) | (c & (a ^ b));
+         };
+
+         uint64 PrevLow = All, PrevHigh = All;
+         uint64 Low, High;
+         Column(0, Low, High);
+
+         for (auto w = 0; w < W; ++w)
+         {
+            uint64 NextLow = All, NextHigh = All;
+            if (w + 1 < W)
+               Column(w + 1, NextLow, NextHigh);
+
+            // Column sums of the west and east neighbours, shifted in line with the tile.
+            const uint64 LowWest = (Low << 1) | (PrevLow >> 63);
+            const uint64 LowEast = (Low >> 1) | (NextLow << 63);
+            const uint64 HighWest = (High << 1) | (PrevHigh >> 63);
+            const uint64 HighEast = (High >> 1) | (NextHigh << 63);
+
+            // Sum = L + 2 * (H0 + 2 * H1 + 4 * H2), rock when the sum is 5 or more.
+            const uint64 L = LowWest ^ Low ^ LowEast;
+            const uint64 CarryL = (LowWest & Low) | (LowEast & (LowWest ^ Low));
+            const uint64 H0 = HighWest ^ High ^ HighEast;
+            const uint64 H1 = (HighWest & High) | (HighEast & (HighWest ^ High));
+            const uint64 H0Sum = H0 ^ CarryL;
+            const uint64 Carry = H0 & CarryL;
+            const uint64 H1Sum = H1 ^ Carry;
+            const uint64 H2 = H1 & Carry;
+
+            Out[w] = H2 | (H1Sum & (H0Sum | L));
+
+            PrevLow = Low;
+            PrevHigh = High;
+            Low = NextLow;
+            High = NextHigh;
+         }
+
+         Out[0] |= 1;
+         Out[(XSize - 1) >> 6] |= uint64(1) << ((XSize - 1) & 63);
+         Out[W - 1] &= Tail;
+      }
+   }, XSize * YSize < FDungeonGenerator::MinParallelCells);
+
+   std::swap(Rock_, Next_);
+}
+
+bool FDungeonCellularPolicy::KeepLargestCave(FIntPoint& OutMin, FIntPoint& OutMax)
+{
+   const auto XSize = Rock_.GetXSize();
+   const auto YSize = Rock_.GetYSize();
+   const auto W = Rock_.GetWordsPerRow();
+   const uint64 Tail = Rock_.TailMask();
+
+   Runs_.clear();
+   RowStarts_.assign(1, 0);
+
+   for (auto y = 0; y != YSize; ++y)
+   {
+      const uint64* Row = Rock_.GetRow(y);
+
+      // Runs of open tiles straight from the words: only the bits where rock and open alternate are
+      // visited, a run may continue into the next word.
+      auto Start = -1;
+      uint64 Carry = 0;
+
+      for (auto w = 0; w != W; ++w)
+      {
+         const uint64 Open = ~Row[w] & (w == W - 1 ? Tail : ~uint64(0));
+
+         for (uint64 Edges = Open ^ ((Open << 1) | Carry); Edges; Edges &= Edges - 1)
+         {
+            const auto x = w * 64 + LowestBit(Edges);
+            if (Start < 0)
+            {
+               Start = x;
+            }
+            else
+            {
+               Runs_.push_back(FRun{ y, Start, x - 1, int32(Runs_.size()) });
+               Start = -1;
+            }
+         }
+
+         Carry = Open >> 63;
+      }
+
+      if (Start >= 0)
+         Runs_.push_back(FRun{ y, Start, XSize - 1, int32(Runs_.size()) });
+
+      RowStarts_.push_back(int32(Runs_.size()));
+
+      // Union with the overlapping runs of the row above, both rows are sorted by x.
+      if (y > 0)
+      {
+         auto Above = RowStarts_[y - 1];
+         for (auto Run = RowStarts_[y]; Run != RowStarts_[y + 1]; ++Run)
+         {
+            while (Above != RowStarts_[y] && Runs_[Above].xEnd < Runs_[Run].xStart)
+               ++Above;
+
+            for (auto Other = Above; Other != RowStarts_[y] && Runs_[Other].xStart <= Runs_[Run].xEnd; ++Other)
+            {
+               const auto A = FindRoot(Run);
+               const auto B = FindRoot(Other);
+               if (A != B)
+                  Runs_[FMath::Max(A, B)].Parent = FMath::Min(A, B);
+            }
+         }
+      }
+   }
+
+   Sizes_.assign(Runs_.size(), 0);
+   RootOfLargest_ = -1;
+
+   for (auto Run = 0; Run != int32(Runs_.size()); ++Run)
+   {
+      const auto Root = FindRoot(Run);
+      Sizes_[Root] += Runs_[Run].xEnd - Runs_[Run].xStart + 1;
+      if (RootOfLargest_ < 0 || Sizes_[Root] > Sizes_[RootOfLargest_])
+         RootOfLargest_ = Root;
+   }
+
+   Floor_.Init(XSize, YSize);
+   OutMin = FIntPoint(XSize, YSize);
+   OutMax = FIntPoint(-1, -1);
+
+   for (auto Run = 0; Run != int32(Runs_.size()); ++Run)
+   {
+      const FRun& Open = Runs_[Run];
+      if (FindRoot(Run) != RootOfLargest_)
+         continue;
+
+      Floor_.SetRect(Open.xStart, Open.y, Open.xEnd, Open.y, true);
+      OutMin = FIntPoint(FMath::Min(OutMin.X, Open.xStart), FMath::Min(OutMin.Y, Open.y));
+      OutMax = FIntPoint(FMath::Max(OutMax.X, Open.xEnd), FMath::Max(OutMax.Y, Open.y));
+   }
+
+   return RootOfLargest_ >= 0;
+}
+
+int32 FDungeonCellularPolicy::FindRoot(int32 Run)
+{
+   // Path halving keeps the trees flat without recursion.
+   while (Runs_[Run].Parent != Run)
+   {
+      Runs_[Run].Parent = Runs_[Runs_[Run].Parent].Parent;
+      Run = Runs_[Run].Parent;
+   }
+
+   return Run;
+}
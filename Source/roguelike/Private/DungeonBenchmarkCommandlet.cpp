@@ -0,0 +1,451 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonBenchmarkCommandlet.h"
+#include "HAL/MemoryBase.h"
+#include "HAL/PlatformTLS.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "DungeonGenerator.h"
+#include "DungeonFieldOfView.h"
+#include "DungeonMapActor.h"
+#include "roguelike.h"
+
+#include <atomic>
+#include <algorithm>
+
+namespace
+{
+   /**
+    * Forwards to the real allocator and counts the allocations of one thread. Global operator new ends
+    * up here as well, so std containers are counted. Other threads (logging, the task graph, stats)
+    * pass straight through.
+    */
+   class FCountingMalloc : public FMalloc
+   {
+   public:
+      explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner), CountedThread(0), Allocs(0), Bytes(0) {}
+
+      virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+      {
+         Count_(Count);
+         return Inner->Malloc(Count, Alignment);
+      }
+
+      virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+      {
+         if (Count)
+            Count_(Count);
+         return Inner->Realloc(Original, Count, Alignment);
+      }
+
+      virtual void Free(void* Original) override { Inner->Free(Original); }
+      virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+      virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+      virtual void Trim() override { Inner->Trim(); }
+      virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+      virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+      virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+      virtual void UpdateStats() override { Inner->UpdateStats(); }
+      virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+      virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+      virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+      virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+      virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+      /** Starts counting the calling thread from zero, false while another thread is being counted. */
+      bool Start()
+      {
+         uint32 Idle = 0;
+         if (!CountedThread.compare_exchange_strong(Idle, FPlatformTLS::GetCurrentThreadId()))
+            return false;
+
+         Allocs = 0;
+         Bytes = 0;
+         return true;
+      }
+
+      void Stop() { CountedThread.store(0); }
+
+      int64 GetAllocs() const { return Allocs; }
+      int64 GetBytes() const { return Bytes; }
+
+   private:
+      void Count_(SIZE_T Count)
+      {
+         // Only the counted thread ever writes the totals.
+         if (CountedThread.load(std::memory_order_relaxed) == FPlatformTLS::GetCurrentThreadId())
+         {
+            ++Allocs;
+            Bytes += int64(Count);
+         }
+      }
+
+      FMalloc* Inner;
+      std::atomic<uint32> CountedThread;
+      int64 Allocs;
+      int64 Bytes;
+   };
+
+   /**
+    * The counter wraps GMalloc from its first use on. It is never removed or freed: other threads may
+    * be inside it at any time, and what they allocated before it was installed goes back to the same
+    * inner allocator either way.
+    */
+   FCountingMalloc& GetCountingMalloc()
+   {
+      static FCountingMalloc* Counter = []()
+      {
+         FCountingMalloc* Installed = new FCountingMalloc(GMalloc);
+         GMalloc = Installed;
+         return Installed;
+      }();
+
+      return *Counter;
+   }
+
+   /** Counts the allocations of the calling thread for the lifetime of the scope, one scope at a time. */
+   class FScopedMallocCounter
+   {
+   public:
+      FScopedMallocCounter() : Counter(GetCountingMalloc()) { verify(Counter.Start()); }
+      ~FScopedMallocCounter() { Counter.Stop(); }
+
+      int64 GetAllocs() const { return Counter.GetAllocs(); }
+      int64 GetBytes() const { return Counter.GetBytes(); }
+
+   private:
+      FCountingMalloc& Counter;
+   };
+
+   TArray<int32> ParseIntList(const FString& Params, const TCHAR* Key, const TCHAR* Default)
+   {
+      FString Text = Default;
+      FParse::Value(*Params, Key, Text, false);
+
+      TArray<FString> Items;
+      Text.ParseIntoArray(Items, TEXT(","));
+
+      TArray<int32> Values;
+      for (const auto& Item : Items)
+         Values.Add(FCString::Atoi(*Item));
+      return Values;
+   }
+
+   TArray<FIntPoint> ParseSizeList(const FString& Params)
+   {
+      FString Text = TEXT("80x25,256x256,1024x1024,4096x4096");
+      FParse::Value(*Params, TEXT("Sizes="), Text, false);
+
+      TArray<FString> Items;
+      Text.ParseIntoArray(Items, TEXT(","));
+
+      TArray<FIntPoint> Sizes;
+      for (const auto& Item : Items)
+      {
+         FString X, Y;
+         if (Item.Split(TEXT("x"), &X, &Y))
+            Sizes.Add(FIntPoint(FCString::Atoi(*X), FCString::Atoi(*Y)));
+      }
+      return Sizes;
+   }
+
+   const TCHAR* GetAlgorithmName(EDungeonAlgorithm Algorithm)
+   {
+      switch (Algorithm)
+      {
+      case EDungeonAlgorithm::DA_BSP:
+         return TEXT("BSP");
+      case EDungeonAlgorithm::DA_Drunkard:
+         return TEXT("Drunkard");
+      case EDungeonAlgorithm::DA_Cellular:
+         return TEXT("Cellular");
+      default:
+         return TEXT("Accretion");
+      }
+   }
+
+   TArray<EDungeonAlgorithm> ParseAlgorithmList(const FString& Params)
+   {
+      FString Text = TEXT("Accretion,BSP,Drunkard,Cellular");
+      FParse::Value(*Params, TEXT("Algorithms="), Text, false);
+
+      TArray<FString> Items;
+      Text.ParseIntoArray(Items, TEXT(","));
+
+      const EDungeonAlgorithm All[] = { EDungeonAlgorithm::DA_Accretion, EDungeonAlgorithm::DA_BSP, EDungeonAlgorithm::DA_Drunkard, EDungeonAlgorithm::DA_Cellular };
+
+      TArray<EDungeonAlgorithm> Algorithms;
+      for (const auto& Item : Items)
+         for (const auto Algorithm : All)
+            if (Item == GetAlgorithmName(Algorithm))
+               Algorithms.Add(Algorithm);
+      return Algorithms;
+   }
+
+   const TCHAR* GetSamplingName(EFeatureSampling Sampling)
+   {
+      return Sampling == EFeatureSampling::FS_Frontier ? TEXT("Frontier") : TEXT("Rejection");
+   }
+
+   const TCHAR* GetStorageName(ETileStorage Storage)
+   {
+      return Storage == ETileStorage::TS_BitPlanes ? TEXT("BitPlanes") : TEXT("Bytes");
+   }
+
+   bool RunFieldOfViewBenchmark(const FString& Params, int32 Seed, const FString& OutFile)
+   {
+      int32 Size = 1024;
+      int32 Samples = 10000;
+      int32 Radius = 20;
+      FParse::Value(*Params, TEXT("FovSize="), Size);
+      FParse::Value(*Params, TEXT("FovSamples="), Samples);
+      FParse::Value(*Params, TEXT("FovRadius="), Radius);
+      Samples = FMath::Max(Samples, 1);
+
+      // Densely packed map so most origins see walls in every direction.
+      FDungeonGenerator Generator;
+      Generator.Seed = Seed;
+      Generator.XSize = Size;
+      Generator.YSize = Size;
+      Generator.MaxFeatures = Size * Size / 50;
+      Generator.Generate();
+
+      FDungeonBitGrid Walkable;
+      Generator.GetWalkable(Walkable);
+
+      TArray<FIntPoint> Origins;
+      for (auto y = 0; y != Size; ++y)
+         for (auto x = 0; x != Size; ++x)
+            if (Walkable.Get(x, y))
+               Origins.Add(FIntPoint(x, y));
+
+      if (Origins.Num() == 0)
+         return false;
+
+      FDungeonFieldOfView FieldOfView;
+      FieldOfView.Reset(Size, Size);
+
+      std::vector<int32> NewlyExplored;
+      TArray<double> Times;
+      Times.Reserve(Samples);
+
+      for (auto i = 0; i != Samples; ++i)
+      {
+         // Large prime stride, spreads the origins over the whole map.
+         const FIntPoint& Origin = Origins[int32((int64(i) * 7919) % Origins.Num())];
+         NewlyExplored.clear();
+
+         const uint64 StartCycles = FPlatformTime::Cycles64();
+         FieldOfView.Compute(Walkable, Origin, Radius, &NewlyExplored);
+         Times.Add(double(FPlatformTime::Cycles64() - StartCycles) * FPlatformTime::GetSecondsPerCycle64() * 1000000.0);
+      }
+
+      Times.Sort();
+
+      double Total = 0.0;
+      for (const auto Time : Times)
+         Total += Time;
+
+      const double Mean = Total / Times.Num();
+      const double Median = Times[Times.Num() / 2];
+      const double P99 = Times[FMath::Min(Times.Num() * 99 / 100, Times.Num() - 1)];
+
+      UE_LOG(Logroguelike, Display, TEXT("DungeonBenchmark: field of view %dx%d radius %d: mean %.2f us, median %.2f us, p99 %.2f us"),
+         Size, Size, Radius, Mean, Median, P99);
+
+      const FString Csv = FString::Printf(TEXT("XSize,YSize,Radius,Samples,MinUs,MeanUs,MedianUs,P99Us\n%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n"),
+         Size, Size, Radius, Samples, Times[0], Mean, Median, P99);
+
+      return FFileHelper::SaveStringToFile(Csv, *OutFile);
+   }
+
+   bool RunBuildBenchmark(const TArray<EDungeonAlgorithm>& Algorithms, const TArray<FIntPoint>& Sizes, int32 MaxFeatures, int32 Seed, int32 Repeats,
+      const FString& OutFile)
+   {
+      const int32 ChunkSizes[] = { 64, MAX_int32 };
+
+      FString Csv = TEXT("Algorithm,XSize,YSize,ChunkTiles,MergeWalls,Instances,MinMs,MedianMs,TilesPerSecond\n");
+
+      for (const auto Algorithm : Algorithms)
+      for (const auto& Size : Sizes)
+      {
+         FDungeonGenerator Generator;
+         Generator.Algorithm = Algorithm;
+         Generator.Seed = Seed;
+         Generator.XSize = Size.X;
+         Generator.YSize = Size.Y;
+         Generator.MaxFeatures = MaxFeatures;
+         Generator.Generate();
+
+         for (const auto ChunkTiles : ChunkSizes)
+         for (const auto bMergeWalls : { false, true })
+         {
+            TArray<double> Times;
+            int32 Instances = 0;
+
+            for (auto Run = 0; Run != Repeats; ++Run)
+            {
+               const double StartTime = FPlatformTime::Seconds();
+               Instances = ADungeonMapActor::ComputeBuildTransforms(Generator, ChunkTiles, bMergeWalls);
+               Times.Add(FPlatformTime::Seconds() - StartTime);
+            }
+
+            Times.Sort();
+            const double MedianSeconds = Times[Times.Num() / 2];
+            const auto ReportedChunkTiles = FMath::Min(ChunkTiles, FMath::Max(Size.X, Size.Y));
+
+            Csv += FString::Printf(TEXT("%s,%d,%d,%d,%d,%d,%.3f,%.3f,%.0f\n"),
+               GetAlgorithmName(Algorithm), Size.X, Size.Y, ReportedChunkTiles, bMergeWalls ? 1 : 0, Instances,
+               Times[0] * 1000.0, MedianSeconds * 1000.0, double(Size.X) * Size.Y / FMath::Max(MedianSeconds, 1e-9));
+
+            UE_LOG(Logroguelike, Display, TEXT("DungeonBenchmark: build %s %dx%d chunks %d%s: %.3f ms, %d instances"),
+               GetAlgorithmName(Algorithm), Size.X, Size.Y, ReportedChunkTiles, bMergeWalls ? TEXT(" merged walls") : TEXT(""),
+               MedianSeconds * 1000.0, Instances);
+         }
+      }
+
+      return FFileHelper::SaveStringToFile(Csv, *OutFile);
+   }
+}
+
+UDungeonBenchmarkCommandlet::UDungeonBenchmarkCommandlet()
+{
+   IsClient = false;
+   IsServer = false;
+   IsEditor = false;
+   LogToConsole = true;
+}
+
+int32 UDungeonBenchmarkCommandlet::Main(const FString& Params)
+{
+   const TArray<FIntPoint> Sizes = ParseSizeList(Params);
+   const TArray<int32> FeatureCounts = ParseIntList(Params, TEXT("Features="), TEXT("100,1000,10000"));
+   const TArray<int32> RoomChances = ParseIntList(Params, TEXT("ChanceRoom="), TEXT("25,50,75"));
+   const TArray<EDungeonAlgorithm> Algorithms = ParseAlgorithmList(Params);
+
+   int32 Seed = 0;
+   int32 Repeats = 5;
+   FParse::Value(*Params, TEXT("Seed="), Seed);
+   FParse::Value(*Params, TEXT("Repeats="), Repeats);
+   Repeats = FMath::Max(Repeats, 1);
+
+   const bool bLayers = FParse::Param(*Params, TEXT("Layers"));
+   int32 AllocatingConfigs = 0;
+
+   FString OutFile = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonBenchmark.csv"));
+   FParse::Value(*Params, TEXT("Out="), OutFile);
+
+   const EFeatureSampling Samplings[] = { EFeatureSampling::FS_Rejection, EFeatureSampling::FS_Frontier };
+   const ETileStorage Storages[] = { ETileStorage::TS_Bytes, ETileStorage::TS_BitPlanes };
+
+   FString Csv = TEXT("Algorithm,XSize,YSize,MaxFeatures,ChanceRoom,Sampling,Storage,MinMs,MedianMs,AllocsPerRun,BytesPerRun,FeaturesPlaced,FailedTries,TriesPerFeature,CellsPerSecond,GridBytesPerCell\n");
+
+   for (const auto Algorithm : Algorithms)
+   for (const auto& Size : Sizes)
+   for (const auto MaxFeatures : FeatureCounts)
+   for (const auto ChanceRoom : RoomChances)
+   for (const auto Sampling : Samplings)
+   for (const auto Storage : Storages)
+   {
+      // Room chances and sampling only steer accretion, the other algorithms run once per size and feature count.
+      const bool bAccretion = Algorithm == EDungeonAlgorithm::DA_Accretion;
+      if (!bAccretion && (ChanceRoom != RoomChances[0] || Sampling != Samplings[1]))
+         continue;
+
+      FDungeonGenerator Generator;
+      Generator.Algorithm = Algorithm;
+      Generator.Seed = Seed;
+      Generator.XSize = Size.X;
+      Generator.YSize = Size.Y;
+      Generator.MaxFeatures = MaxFeatures;
+      Generator.ChanceRoom = ChanceRoom;
+      Generator.ChanceCorridor = 100 - ChanceRoom;
+      Generator.Sampling = Sampling;
+      Generator.Storage = Storage;
+
+      if (bLayers)
+      {
+         Generator.GeneratedLayers = (1 << int32(EDungeonLayer::DL_RoomId)) | (1 << int32(EDungeonLayer::DL_RegionId)) |
+            (1 << int32(EDungeonLayer::DL_EntranceDistance));
+         Generator.bRecordGraph = true;
+      }
+
+      // Warm up, the first run sizes the grid, the frontier and every scratch buffer.
+      Generator.Generate();
+
+      TArray<double> Times;
+      int64 Allocs = 0;
+      int64 Bytes = 0;
+
+      for (auto Run = 0; Run != Repeats; ++Run)
+      {
+         FScopedMallocCounter Counter;
+
+         const double StartTime = FPlatformTime::Seconds();
+         Generator.Generate();
+         Times.Add(FPlatformTime::Seconds() - StartTime);
+
+         Allocs += Counter.GetAllocs();
+         Bytes += Counter.GetBytes();
+      }
+
+      Times.Sort();
+      const double MinSeconds = Times[0];
+      const double MedianSeconds = Times[Times.Num() / 2];
+
+      // Every run uses the same seed, so the stats of the last one stand for all of them.
+      const auto& Stats = Generator.GetStats();
+      const auto Tries = Stats.FeaturesPlaced + Stats.FailedTries;
+
+      Csv += FString::Printf(TEXT("%s,%d,%d,%d,%d,%s,%s,%.3f,%.3f,%lld,%lld,%d,%d,%.2f,%.0f,%.3f\n"),
+         GetAlgorithmName(Algorithm), Size.X, Size.Y, MaxFeatures, ChanceRoom, GetSamplingName(Sampling), GetStorageName(Storage),
+         MinSeconds * 1000.0, MedianSeconds * 1000.0, Allocs / Repeats, Bytes / Repeats,
+         Stats.FeaturesPlaced, Stats.FailedTries, Stats.FeaturesPlaced ? double(Tries) / Stats.FeaturesPlaced : 0.0,
+         double(Size.X) * Size.Y / FMath::Max(MedianSeconds, 1e-9), double(Generator.GetGridAllocatedSize()) / (double(Size.X) * Size.Y));
+
+      UE_LOG(Logroguelike, Display, TEXT("DungeonBenchmark: %s %dx%d features %d room %d %s/%s: %.3f ms, %d placed, %lld allocs"),
+         GetAlgorithmName(Algorithm), Size.X, Size.Y, MaxFeatures, ChanceRoom, GetSamplingName(Sampling), GetStorageName(Storage),
+         MedianSeconds * 1000.0, Stats.FeaturesPlaced, Allocs / Repeats);
+
+      // Same seed as the warm up, so every buffer already has the size it needs. Only the tasks of the
+      // parallel passes of large cave maps come from the heap.
+      const bool bParallel = (Algorithm == EDungeonAlgorithm::DA_Drunkard || Algorithm == EDungeonAlgorithm::DA_Cellular) &&
+         Size.X * Size.Y >= FDungeonGenerator::MinParallelCells;
+      if (Allocs > 0 && !bParallel)
+      {
+         UE_LOG(Logroguelike, Warning, TEXT("DungeonBenchmark: %s %dx%d features %d regenerated with %lld allocations per run, expected none"),
+            GetAlgorithmName(Algorithm), Size.X, Size.Y, MaxFeatures, Allocs / Repeats);
+         ++AllocatingConfigs;
+      }
+   }
+
+   if (!FFileHelper::SaveStringToFile(Csv, *OutFile))
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonBenchmark: failed to write %s"), *OutFile);
+      return 1;
+   }
+
+   const FString FovFile = FPaths::Combine(FPaths::GetPath(OutFile), FPaths::GetBaseFilename(OutFile) + TEXT("_Fov.csv"));
+   if (!RunFieldOfViewBenchmark(Params, Seed, FovFile))
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonBenchmark: field of view benchmark failed, see %s"), *FovFile);
+      return 1;
+   }
+
+   const FString BuildFile = FPaths::Combine(FPaths::GetPath(OutFile), FPaths::GetBaseFilename(OutFile) + TEXT("_Build.csv"));
+   if (!RunBuildBenchmark(Algorithms, Sizes, FeatureCounts.Num() ? FeatureCounts.Last() : 1000, Seed, Repeats, BuildFile))
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonBenchmark: failed to write %s"), *BuildFile);
+      return 1;
+   }
+
+   UE_LOG(Logroguelike, Display, TEXT("DungeonBenchmark: results in %s, %s and %s"), *OutFile, *FovFile, *BuildFile);
+
+   if (AllocatingConfigs > 0)
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonBenchmark: %d configurations allocated while regenerating"), AllocatingConfigs);
+      return 1;
+   }
+
+   return 0;
+}
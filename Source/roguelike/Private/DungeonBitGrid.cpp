@@ -0,0 +1,170 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonBitGrid.h"
+
+FDungeonBitGrid::FDungeonBitGrid()
+   : XSize_(0)
+   , YSize_(0)
+   , WordsPerRow_(0)
+{
+}
+
+void FDungeonBitGrid::Init(int32 InXSize, int32 InYSize)
+{
+   XSize_ = InXSize;
+   YSize_ = InYSize;
+   WordsPerRow_ = (InXSize + 63) / 64;
+   Words_.assign(WordsPerRow_ * InYSize, 0);
+}
+
+void FDungeonBitGrid::SetRect(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, bool bValue)
+{
+   if (xStart > xEnd || yStart > yEnd)
+      return;
+
+   const auto wStart = xStart >> 6;
+   const auto wEnd = xEnd >> 6;
+
+   for (auto y = yStart; y <= yEnd; ++y)
+   {
+      uint64* Row = &Words_[WordsPerRow_ * y];
+
+      for (auto w = wStart; w <= wEnd; ++w)
+      {
+         const uint64 Mask = RangeMask(w == wStart ? (xStart & 63) : 0, w == wEnd ? (xEnd & 63) : 63);
+         Row[w] = bValue ? (Row[w] | Mask) : (Row[w] & ~Mask);
+      }
+   }
+}
+
+bool FDungeonBitGrid::AnyInRect(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd) const
+{
+   if (xStart > xEnd || yStart > yEnd)
+      return false;
+
+   const auto wStart = xStart >> 6;
+   const auto wEnd = xEnd >> 6;
+
+   // Features are narrower than a word, so this is one or two word tests per row.
+   for (auto y = yStart; y <= yEnd; ++y)
+   {
+      const uint64* Row = &Words_[WordsPerRow_ * y];
+
+      for (auto w = wStart; w <= wEnd; ++w)
+      {
+         const uint64 Mask = RangeMask(w == wStart ? (xStart & 63) : 0, w == wEnd ? (xEnd & 63) : 63);
+         if (Row[w] & Mask)
+            return true;
+      }
+   }
+
+   return false;
+}
+
+void FDungeonBitGrid::Or(const FDungeonBitGrid& Other)
+{
+   const auto Count = Words_.size();
+   uint64* Dst = Words_.data();
+   const uint64* Src = Other.Words_.data();
+
+   for (size_t i = 0; i != Count; ++i)
+      Dst[i] |= Src[i];
+}
+
+void FDungeonBitGrid::AndNot(const FDungeonBitGrid& Other)
+{
+   const auto Count = Words_.size();
+   uint64* Dst = Words_.data();
+   const uint64* Src = Other.Words_.data();
+
+   for (size_t i = 0; i != Count; ++i)
+      Dst[i] &= ~Src[i];
+}
+
+void FDungeonBitGrid::SetAdjacent(const FDungeonBitGrid& Source)
+{
+   check(this != &Source);
+
+   XSize_ = Source.XSize_;
+   YSize_ = Source.YSize_;
+   WordsPerRow_ = Source.WordsPerRow_;
+   Words_.resize(Source.Words_.size());
+
+   const auto W = WordsPerRow_;
+   const uint64 Tail = TailMask();
+
+   if (W == 0)
+      return;
+
+   for (auto y = 0; y < YSize_; ++y)
+   {
+      const uint64* Row = &Source.Words_[W * y];
+      const uint64* Up = y > 0 ? Row - W : nullptr;
+      const uint64* Down = y + 1 < YSize_ ? Row + W : nullptr;
+      uint64* Out = &Words_[W * y];
+
+      // West and east neighbours are the row shifted by one bit, carrying across word boundaries.
+      for (auto w = 0; w < W; ++w)
+      {
+         uint64 Bits = (Row[w] << 1) | (Row[w] >> 1);
+         if (w > 0)
+            Bits |= Row[w - 1] >> 63;
+         if (w + 1 < W)
+            Bits |= Row[w + 1] << 63;
+         Out[w] = Bits;
+      }
+
+      if (Up)
+         for (auto w = 0; w < W; ++w)
+            Out[w] |= Up[w];
+
+      if (Down)
+         for (auto w = 0; w < W; ++w)
+            Out[w] |= Down[w];
+
+      Out[W - 1] &= Tail;
+   }
+}
+
+void FDungeonBitGrid::SetSurrounding(const FDungeonBitGrid& Source)
+{
+   check(this != &Source);
+
+   XSize_ = Source.XSize_;
+   YSize_ = Source.YSize_;
+   WordsPerRow_ = Source.WordsPerRow_;
+   Words_.resize(Source.Words_.size());
+
+   const auto W = WordsPerRow_;
+   const uint64 Tail = TailMask();
+
+   if (W == 0)
+      return;
+
+   for (auto y = 0; y < YSize_; ++y)
+   {
+      const uint64* Row = &Source.Words_[W * y];
+      const uint64* Up = y > 0 ? Row - W : nullptr;
+      const uint64* Down = y + 1 < YSize_ ? Row + W : nullptr;
+      uint64* Out = &Words_[W * y];
+
+      // The three rows merged first, then widened by a bit to either side like in SetAdjacent().
+      auto Column = [Row, Up, Down](int32 w)
+      {
+         return Row[w] | (Up ? Up[w] : 0) | (Down ? Down[w] : 0);
+      };
+
+      uint64 Previous = 0;
+      uint64 Current = Column(0);
+
+      for (auto w = 0; w < W; ++w)
+      {
+         const uint64 Next = w + 1 < W ? Column(w + 1) : 0;
+         Out[w] = Current | (Current << 1) | (Current >> 1) | (Previous >> 63) | (Next << 63);
+         Previous = Current;
+         Current = Next;
+      }
+
+      Out[W - 1] &= Tail;
+   }
+}
@@ -0,0 +1,242 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonChunks.h"
+#include "DungeonProfiling.h"
+
+FDungeonChunkPlanner::FDungeonChunkPlanner()
+   : Seed(0)
+   , ChunkSize(32)
+   , Margin(8)
+   , MaxFeatures(20)
+   , ChanceRoom(75)
+   , ChanceCorridor(25)
+   , Sampling(EFeatureSampling::FS_Frontier)
+   , MaxCachedPlans(64)
+   , UseCounter_(0)
+{
+}
+
+void FDungeonChunkPlanner::Reset()
+{
+   // Portals need two tiles of clearance from the chunk corners and plans may only reach the direct neighbours.
+   ChunkSize = FMath::Max(ChunkSize, 8);
+   Margin = FMath::Clamp(Margin, 0, ChunkSize);
+
+   // Slots keep their buffers, the next plans are made into them.
+   for (auto& Plan : Plans_)
+      Plan.LastUse = 0;
+
+   Plans_.reserve(FMath::Max(MaxCachedPlans, 9));
+   UseCounter_ = 0;
+}
+
+uint64 FDungeonChunkPlanner::GetChunkKey(const FIntPoint& Coord)
+{
+   return (uint64(uint32(Coord.X)) << 32) | uint64(uint32(Coord.Y));
+}
+
+int32 FDungeonChunkPlanner::FloorDiv(int32 Value, int32 Divisor)
+{
+   return Value >= 0 ? Value / Divisor : -((-Value + Divisor - 1) / Divisor);
+}
+
+int32 FDungeonChunkPlanner::GetTileRank(ETileType tile)
+{
+   switch (tile)
+   {
+   case ETileType::TE_Unused:
+      return 0;
+   case ETileType::TE_DirtWall:
+      return 1;
+   case ETileType::TE_Corridor:
+      return 2;
+   case ETileType::TE_DirtFloor:
+      return 3;
+   case ETileType::TE_Door:
+      return 4;
+   case ETileType::TE_UpStairs:
+   case ETileType::TE_DownStairs:
+      return 5;
+   }
+
+   return 0;
+}
+
+void FDungeonChunkPlanner::BuildChunk(const FIntPoint& Coord, std::vector<ETileType>& OutCells)
+{
+   const auto Window = ChunkSize + 2 * Margin;
+
+   OutCells.assign(ChunkSize * ChunkSize, ETileType::TE_Unused);
+
+   for (auto dy = -1; dy <= 1; ++dy)
+   {
+      for (auto dx = -1; dx <= 1; ++dx)
+      {
+         const auto& Plan = GetPlan(FIntPoint(Coord.X + dx, Coord.Y + dy));
+
+         // Origin of the neighbour's plan window relative to this chunk.
+         const auto xOrigin = dx * ChunkSize - Margin;
+         const auto yOrigin = dy * ChunkSize - Margin;
+
+         const auto xBegin = FMath::Max(0, xOrigin);
+         const auto xEnd = FMath::Min(ChunkSize, xOrigin + Window);
+         const auto yBegin = FMath::Max(0, yOrigin);
+         const auto yEnd = FMath::Min(ChunkSize, yOrigin + Window);
+
+         for (auto y = yBegin; y < yEnd; ++y)
+         {
+            for (auto x = xBegin; x < xEnd; ++x)
+            {
+               const auto tile = Plan[(x - xOrigin) + Window * (y - yOrigin)];
+               auto& cell = OutCells[x + ChunkSize * y];
+
+               if (GetTileRank(tile) > GetTileRank(cell))
+                  cell = tile;
+            }
+         }
+      }
+   }
+}
+
+const std::vector<ETileType>& FDungeonChunkPlanner::GetPlan(const FIntPoint& Coord)
+{
+   const auto Key = GetChunkKey(Coord);
+
+   FPlan* Found = nullptr;
+   for (auto& Plan : Plans_)
+   {
+      if (Plan.LastUse && Plan.Key == Key)
+      {
+         Found = &Plan;
+         break;
+      }
+   }
+
+   if (!Found)
+   {
+      // A chunk needs its own plan and the eight around it. Once every slot is taken the least recently
+      // used one is made over, free slots have a LastUse of 0 and go first.
+      if (int32(Plans_.size()) < FMath::Max(MaxCachedPlans, 9))
+      {
+         Plans_.emplace_back();
+         Found = &Plans_.back();
+      }
+      else
+      {
+         Found = &Plans_[0];
+         for (auto& Plan : Plans_)
+            if (Plan.LastUse < Found->LastUse)
+               Found = &Plan;
+      }
+
+      Found->Key = Key;
+      MakePlan(Coord, Found->Cells);
+   }
+
+   Found->LastUse = ++UseCounter_;
+
+   return Found->Cells;
+}
+
+void FDungeonChunkPlanner::MakePlan(const FIntPoint& Coord, std::vector<ETileType>& OutCells)
+{
+   const auto Window = ChunkSize + 2 * Margin;
+
+   Generator_.Seed = Seed;
+   Generator_.Stream = GetChunkKey(Coord);
+   Generator_.XSize = Window;
+   Generator_.YSize = Window;
+   Generator_.MaxFeatures = MaxFeatures;
+   Generator_.ChanceRoom = ChanceRoom;
+   Generator_.ChanceCorridor = ChanceCorridor;
+   Generator_.Sampling = Sampling;
+   Generator_.Reset();
+
+   const auto First = Margin;
+   const auto Last = Margin + ChunkSize - 1;
+   const auto Center = Margin + ChunkSize / 2;
+
+   // Start room like MakeDungeon() does, then hook it up to the portal on each border.
+   Generator_.MakeRoom(Center, Center, 8, 6, Generator_.GetRandomDirection());
+
+   CarvePath(Last, First + GetPortal(Coord.X, Coord.Y, false), Center, Center, true);
+   CarvePath(First, First + GetPortal(Coord.X - 1, Coord.Y, false), Center, Center, true);
+   CarvePath(First + GetPortal(Coord.X, Coord.Y, true), Last, Center, Center, false);
+   CarvePath(First + GetPortal(Coord.X, Coord.Y - 1, true), First, Center, Center, false);
+
+   Generator_.MakeFeatures(MaxFeatures);
+
+   // Plans have no stairs, only the feature counters apply.
+   FDungeonCounters::AddGeneratorStats(Generator_.GetStats(), false);
+
+   // Copy rather than take the grid, so neither the generator nor the plan reallocates once both are warm.
+   OutCells.assign(Generator_.GetData().begin(), Generator_.GetData().end());
+}
+
+int32 FDungeonChunkPlanner::GetPortal(int32 cx, int32 cy, bool bSouth) const
+{
+   return 2 + int32(Hash(cx, cy, bSouth ? 2 : 1) % uint64(ChunkSize - 4));
+}
+
+uint64 FDungeonChunkPlanner::Hash(int32 cx, int32 cy, uint32 salt) const
+{
+   const auto h = FDungeonRng::Mix(uint64(uint32(Seed)) ^ FDungeonRng::Mix(GetChunkKey(FIntPoint(cx, cy))));
+   return FDungeonRng::Mix(h ^ salt);
+}
+
+void FDungeonChunkPlanner::CarvePath(int32 xFrom, int32 yFrom, int32 xTo, int32 yTo, bool bHorizontalFirst)
+{
+   auto Step = [](int32 From, int32 To) { return From + (To > From ? 1 : 0) - (To < From ? 1 : 0); };
+
+   auto x = xFrom;
+   auto y = yFrom;
+
+   for (;;)
+   {
+      auto xNext = x;
+      auto yNext = y;
+
+      if (bHorizontalFirst)
+      {
+         if (x != xTo)
+            xNext = Step(x, xTo);
+         else
+            yNext = Step(y, yTo);
+      }
+      else
+      {
+         if (y != yTo)
+            yNext = Step(y, yTo);
+         else
+            xNext = Step(x, xTo);
+      }
+
+      if (!CarveStep(x, y, xNext, yNext))
+         return;
+
+      if (x == xTo && y == yTo)
+         return;
+
+      x = xNext;
+      y = yNext;
+   }
+}
+
+bool FDungeonChunkPlanner::CarveStep(int32 x, int32 y, int32 xNext, int32 yNext)
+{
+   switch (Generator_.GetCell(x, y))
+   {
+   case ETileType::TE_DirtFloor:
+   case ETileType::TE_Door:
+   case ETileType::TE_UpStairs:
+   case ETileType::TE_DownStairs:
+      return false;
+   case ETileType::TE_DirtWall:
+      // Break into the room through a door, a corridor running along the wall just replaces it.
+      Generator_.SetCell(x, y, Generator_.GetCell(xNext, yNext) == ETileType::TE_DirtFloor ? ETileType::TE_Door : ETileType::TE_Corridor);
+      return true;
+   default:
+      Generator_.SetCell(x, y, ETileType::TE_Corridor);
+      return true;
+   }
+}
@@ -0,0 +1,164 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonEntities.h"
+
+const int32 FDungeonEntities::TurnTime;
+
+FDungeonEntities::FDungeonEntities()
+   : XSize_(1)
+   , NumAlive_(0)
+   , Time_(0)
+   , HashShift_(32)
+{
+}
+
+void FDungeonEntities::Reset(int32 InXSize)
+{
+   XSize_ = FMath::Max(InXSize, 1);
+   NumAlive_ = 0;
+   Time_ = 0;
+
+   // Generations survive, ids handed out before the reset stay invalid.
+   FreeSlots_.clear();
+   for (auto Slot = int32(Generation_.size()) - 1; Slot >= 0; --Slot)
+   {
+      if (Alive_[Slot])
+         ++Generation_[Slot];
+      Alive_[Slot] = 0;
+      FreeSlots_.push_back(Slot);
+   }
+
+   std::fill(Buckets_.begin(), Buckets_.end(), -1);
+   Queue_.clear();
+}
+
+FDungeonEntityId FDungeonEntities::Spawn(EDungeonEntityKind Kind, int32 Type, const FIntPoint& Tile, int32 Speed)
+{
+   int32 Slot;
+
+   if (FreeSlots_.empty())
+   {
+      Slot = int32(Generation_.size());
+      Cell_.push_back(0);
+      Kind_.push_back(Kind);
+      Type_.push_back(0);
+      Speed_.push_back(0);
+      Generation_.push_back(0);
+      Alive_.push_back(0);
+      NextInBucket_.push_back(-1);
+   }
+   else
+   {
+      Slot = FreeSlots_.back();
+      FreeSlots_.pop_back();
+   }
+
+   Cell_[Slot] = Tile.X + XSize_ * Tile.Y;
+   Kind_[Slot] = Kind;
+   Type_[Slot] = Type;
+   Speed_[Slot] = FMath::Max(Speed, 0);
+   Alive_[Slot] = 1;
+   ++NumAlive_;
+
+   if (int32(Buckets_.size()) < 2 * NumAlive_)
+      Rehash(2 * NumAlive_);
+   else
+      Link(Slot);
+
+   if (Speed_[Slot] > 0)
+      Schedule(Slot, Time_ + int64(TurnTime) * TurnTime / Speed_[Slot]);
+
+   return GetId(Slot);
+}
+
+bool FDungeonEntities::Despawn(const FDungeonEntityId& Id)
+{
+   if (!IsValid(Id))
+      return false;
+
+   // Queued turns are dropped lazily, they no longer match the generation.
+   Unlink(Id.Slot);
+   Alive_[Id.Slot] = 0;
+   ++Generation_[Id.Slot];
+   FreeSlots_.push_back(Id.Slot);
+   --NumAlive_;
+
+   return true;
+}
+
+bool FDungeonEntities::IsValid(const FDungeonEntityId& Id) const
+{
+   return Id.Slot >= 0 && Id.Slot < GetNumSlots() && Alive_[Id.Slot] && Generation_[Id.Slot] == Id.Generation;
+}
+
+void FDungeonEntities::Move(int32 Slot, const FIntPoint& Tile)
+{
+   const auto Cell = Tile.X + XSize_ * Tile.Y;
+   if (Cell == Cell_[Slot])
+      return;
+
+   Unlink(Slot);
+   Cell_[Slot] = Cell;
+   Link(Slot);
+}
+
+int32 FDungeonEntities::FindAt(const FIntPoint& Tile, EDungeonEntityKind Kind) const
+{
+   int32 Found = -1;
+
+   ForEachAt(Tile, [this, Kind, &Found](int32 Slot)
+   {
+      if (Kind_[Slot] != Kind)
+         return true;
+
+      Found = Slot;
+      return false;
+   });
+
+   return Found;
+}
+
+void FDungeonEntities::Link(int32 Slot)
+{
+   int32& Head = Buckets_[Hash(Cell_[Slot])];
+   NextInBucket_[Slot] = Head;
+   Head = Slot;
+}
+
+void FDungeonEntities::Unlink(int32 Slot)
+{
+   // Buckets hold about half an entity on average, walking one is cheaper than a doubly linked list.
+   for (int32* Link = &Buckets_[Hash(Cell_[Slot])]; *Link >= 0; Link = &NextInBucket_[*Link])
+   {
+      if (*Link == Slot)
+      {
+         *Link = NextInBucket_[Slot];
+         return;
+      }
+   }
+}
+
+void FDungeonEntities::Rehash(int32 MinBuckets)
+{
+   auto Bits = 4;
+   while ((1 << Bits) < MinBuckets)
+      ++Bits;
+
+   HashShift_ = 32 - Bits;
+   Buckets_.assign(size_t(1) << Bits, -1);
+
+   for (auto Slot = 0; Slot != GetNumSlots(); ++Slot)
+      if (Alive_[Slot])
+         Link(Slot);
+}
+
+void FDungeonEntities::Schedule(int32 Slot, int64 Time)
+{
+   FTurn Turn;
+   Turn.Time = Time;
+   Turn.Slot = Slot;
+   Turn.Generation = Generation_[Slot];
+
+   Queue_.push_back(Turn);
+   std::push_heap(Queue_.begin(), Queue_.end());
+}
@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonFieldOfView.h"
+
+namespace
+{
+   // Octant transforms (xx, xy, yx, yy) mapping scan coordinates to map offsets
+   const int32 Octants[8][4] =
+   {
+      { 1, 0, 0, 1 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { -1, 0, 0, 1 },
+      { -1, 0, 0, -1 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 }, { 1, 0, 0, -1 }
+   };
+}
+
+FDungeonFieldOfView::FDungeonFieldOfView()
+   : LitMinX_(0)
+   , LitMinY_(0)
+   , LitMaxX_(-1)
+   , LitMaxY_(-1)
+   , Transparent_(nullptr)
+   , Radius_(0)
+   , NewlyExplored_(nullptr)
+{
+}
+
+void FDungeonFieldOfView::Reset(int32 XSize, int32 YSize)
+{
+   Visible_.Init(XSize, YSize);
+   Explored_.Init(XSize, YSize);
+
+   LitMaxX_ = -1;
+   LitMaxY_ = -1;
+}
+
+void FDungeonFieldOfView::Compute(const FDungeonBitGrid& Transparent, const FIntPoint& Origin, int32 Radius, std::vector<int32>* OutNewlyExplored)
+{
+   check(Transparent.GetXSize() == Visible_.GetXSize() && Transparent.GetYSize() == Visible_.GetYSize());
+
+   Visible_.SetRect(LitMinX_, LitMinY_, LitMaxX_, LitMaxY_, false);
+
+   LitMinX_ = FMath::Max(Origin.X - Radius, 0);
+   LitMinY_ = FMath::Max(Origin.Y - Radius, 0);
+   LitMaxX_ = FMath::Min(Origin.X + Radius, Visible_.GetXSize() - 1);
+   LitMaxY_ = FMath::Min(Origin.Y + Radius, Visible_.GetYSize() - 1);
+
+   if (!IsInside(Origin.X, Origin.Y))
+      return;
+
+   Transparent_ = &Transparent;
+   Origin_ = Origin;
+   Radius_ = Radius;
+   NewlyExplored_ = OutNewlyExplored;
+
+   Light(Origin.X, Origin.Y);
+
+   for (const auto& Octant : Octants)
+      CastLight(1, 1.0f, 0.0f, Octant[0], Octant[1], Octant[2], Octant[3]);
+
+   Transparent_ = nullptr;
+   NewlyExplored_ = nullptr;
+}
+
+void FDungeonFieldOfView::CastLight(int32 Row, float Start, float End, int32 xx, int32 xy, int32 yx, int32 yy)
+{
+   if (Start < End)
+      return;
+
+   const auto RadiusSquared = Radius_ * Radius_;
+   float NewStart = 0.0f;
+
+   for (auto j = Row; j <= Radius_; ++j)
+   {
+      const auto dy = -j;
+      bool bBlocked = false;
+
+      for (auto dx = -j; dx <= 0; ++dx)
+      {
+         const auto x = Origin_.X + dx * xx + dy * xy;
+         const auto y = Origin_.Y + dx * yx + dy * yy;
+
+         // Slopes through the left and right edge of the tile
+         const float LeftSlope = (dx - 0.5f) / (dy + 0.5f);
+         const float RightSlope = (dx + 0.5f) / (dy - 0.5f);
+
+         if (Start < RightSlope)
+            continue;
+         if (End > LeftSlope)
+            break;
+
+         const bool bInside = IsInside(x, y);
+         if (bInside && dx * dx + dy * dy < RadiusSquared)
+            Light(x, y);
+
+         const bool bOpaque = !bInside || !Transparent_->Get(x, y);
+
+         if (bBlocked)
+         {
+            if (bOpaque)
+            {
+               NewStart = RightSlope;
+               continue;
+            }
+
+            bBlocked = false;
+            Start = NewStart;
+         }
+         else if (bOpaque && j < Radius_)
+         {
+            // Scan the part of the next rows left of this blocker with a narrower window.
+            bBlocked = true;
+            CastLight(j + 1, Start, LeftSlope, xx, xy, yx, yy);
+            NewStart = RightSlope;
+         }
+      }
+
+      if (bBlocked)
+         break;
+   }
+}
+
+void FDungeonFieldOfView::Light(int32 x, int32 y)
+{
+   Visible_.Set(x, y, true);
+
+   if (!Explored_.Get(x, y))
+   {
+      Explored_.Set(x, y, true);
+      if (NewlyExplored_)
+         NewlyExplored_->push_back(x + Explored_.GetXSize() * y);
+   }
+}
@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonFlowField.h"
+
+namespace
+{
+   const int32 StepX[] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+   const int32 StepY[] = { -1, 0, 1, 0, -1, 1, 1, -1 };
+}
+
+const int32 FDungeonFlowField::Unreached;
+
+FDungeonFlowField::FDungeonFlowField()
+   : XSize_(0)
+   , YSize_(0)
+{
+}
+
+void FDungeonFlowField::Compute(const FDungeonBitGrid& Walkable, const std::vector<FIntPoint>& Goals, int32 MaxRadius)
+{
+   Seeds_.clear();
+
+   for (const FIntPoint& Goal : Goals)
+   {
+      if (Goal.X >= 0 && Goal.Y >= 0 && Goal.X < Walkable.GetXSize() && Goal.Y < Walkable.GetYSize())
+      {
+         FSeed Seed;
+         Seed.Cell = Goal.X + Walkable.GetXSize() * Goal.Y;
+         Seed.Cost = 0;
+         Seeds_.push_back(Seed);
+      }
+   }
+
+   Run(Walkable, MaxRadius);
+}
+
+void FDungeonFlowField::ComputeFlee(const FDungeonBitGrid& Walkable, const FDungeonFlowField& Toward, float Coefficient)
+{
+   Seeds_.clear();
+
+   if (Toward.XSize_ != Walkable.GetXSize() || Toward.YSize_ != Walkable.GetYSize())
+   {
+      Run(Walkable, 0);
+      return;
+   }
+
+   // Negated distances shifted to start at zero, the bucket queue only handles costs >= 0.
+   int32 Farthest = 0;
+   for (const auto Cell : Toward.Reached_)
+      Farthest = FMath::Max(Farthest, Toward.Distance_[Cell]);
+
+   const auto Top = FMath::RoundToInt(Farthest * Coefficient);
+
+   for (const auto Cell : Toward.Reached_)
+   {
+      FSeed Seed;
+      Seed.Cell = Cell;
+      Seed.Cost = Top - FMath::RoundToInt(Toward.Distance_[Cell] * Coefficient);
+      Seeds_.push_back(Seed);
+   }
+
+   // The rescan may leave the area of Toward, but never by more steps than the deepest seed.
+   Run(Walkable, Top);
+}
+
+void FDungeonFlowField::Run(const FDungeonBitGrid& Walkable, int32 MaxCost)
+{
+   const auto XSize = Walkable.GetXSize();
+   const auto YSize = Walkable.GetYSize();
+
+   if (XSize != XSize_ || YSize != YSize_)
+   {
+      XSize_ = XSize;
+      YSize_ = YSize;
+      Distance_.assign(XSize * YSize, Unreached);
+   }
+   else
+   {
+      for (const auto Cell : Reached_)
+         Distance_[Cell] = Unreached;
+   }
+
+   Reached_.clear();
+
+   auto Push = [this](int32 Cell, int32 Cost)
+   {
+      if (Distance_[Cell] == Unreached)
+         Reached_.push_back(Cell);
+
+      Distance_[Cell] = Cost;
+
+      if (int32(Buckets_.size()) <= Cost)
+         Buckets_.resize(Cost + 1);
+      Buckets_[Cost].push_back(Cell);
+   };
+
+   int32 Last = -1;
+
+   for (const FSeed& Seed : Seeds_)
+   {
+      if (Seed.Cost >= Distance_[Seed.Cell] || !Walkable.Get(Seed.Cell % XSize, Seed.Cell / XSize))
+         continue;
+
+      Push(Seed.Cell, Seed.Cost);
+      Last = FMath::Max(Last, Seed.Cost);
+   }
+
+   for (auto Cost = 0; Cost <= Last; ++Cost)
+   {
+      // Pushing may grow Buckets_, so the bucket is indexed rather than referenced.
+      for (size_t i = 0; i != Buckets_[Cost].size(); ++i)
+      {
+         const auto Cell = Buckets_[Cost][i];
+         if (Distance_[Cell] != Cost || Cost >= MaxCost)
+            continue;
+
+         const auto x = Cell % XSize;
+         const auto y = Cell / XSize;
+
+         for (auto d = 0; d != 8; ++d)
+         {
+            const auto nx = x + StepX[d];
+            const auto ny = y + StepY[d];
+
+            if (nx < 0 || ny < 0 || nx >= XSize || ny >= YSize || !Walkable.Get(nx, ny))
+               continue;
+
+            // No cutting corners, both tiles beside a diagonal step have to be walkable.
+            if (d >= 4 && (!Walkable.Get(nx, y) || !Walkable.Get(x, ny)))
+               continue;
+
+            const auto Next = nx + XSize * ny;
+            if (Distance_[Next] > Cost + 1)
+            {
+               Push(Next, Cost + 1);
+               Last = FMath::Max(Last, Cost + 1);
+            }
+         }
+      }
+
+      // Cleared but not freed, the next run reuses the buckets.
+      Buckets_[Cost].clear();
+   }
+}
+
+bool FDungeonFlowField::GetNextStep(const FIntPoint& Tile, FIntPoint& OutStep) const
+{
+   auto Best = GetDistance(Tile.X, Tile.Y);
+   if (Best == Unreached)
+      return false;
+
+   bool bFound = false;
+
+   for (auto d = 0; d != 8; ++d)
+   {
+      const auto nx = Tile.X + StepX[d];
+      const auto ny = Tile.Y + StepY[d];
+      const auto Distance = GetDistance(nx, ny);
+
+      if (Distance >= Best)
+         continue;
+
+      // The walkable grid is not kept, reached tiles beside the diagonal stand in for it.
+      if (d >= 4 && (GetDistance(nx, Tile.Y) == Unreached || GetDistance(Tile.X, ny) == Unreached))
+         continue;
+
+      Best = Distance;
+      OutStep = FIntPoint(nx, ny);
+      bFound = true;
+   }
+
+   return bFound;
+}
@@ -0,0 +1,847 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonGenerator.h"
+#include "DungeonProfiling.h"
+#include "Async/ParallelFor.h"
+
+#include <algorithm>
+
+DECLARE_CYCLE_STAT(TEXT("Generate"), STAT_DungeonGenerate, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("MakeFeature"), STAT_DungeonMakeFeature, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("MakeStairs"), STAT_DungeonMakeStairs, STATGROUP_Dungeon);
+
+FDungeonGenerator::FDungeonGenerator()
+   : Seed(0)
+   , Stream(0)
+   , XSize(80)
+   , YSize(25)
+   , MaxFeatures(100)
+   , ChanceRoom(75)
+   , ChanceCorridor(25)
+   , Sampling(EFeatureSampling::FS_Frontier)
+   , Storage(ETileStorage::TS_Bytes)
+   , Algorithm(EDungeonAlgorithm::DA_Accretion)
+   , CaveIterations(5)
+   , GeneratedLayers(0)
+   , bRecordGraph(false)
+   , CancelFlag(nullptr)
+   , bTrackAnchors_(false)
+{
+}
+
+void FDungeonGenerator::Reset()
+{
+   // Refilled in place, the grid only reallocates when the map grows.
+   Data_.assign(Storage == ETileStorage::TS_Bytes ? XSize * YSize : 0, ETileType::TE_Unused);
+
+   for (auto& Plane : Planes_)
+      Plane.Init(Storage == ETileStorage::TS_BitPlanes ? XSize : 0, Storage == ETileStorage::TS_BitPlanes ? YSize : 0);
+
+   // Layers keep their memory across runs, the ones the algorithm fills are allocated up front.
+   Layers_.Resize(XSize, YSize);
+   for (auto Layer : { EDungeonLayer::DL_RoomId, EDungeonLayer::DL_RegionId, EDungeonLayer::DL_EntranceDistance })
+      if (GeneratedLayers & (1 << int32(Layer)))
+         Layers_.Allocate(Layer);
+
+   Graph_.Reset();
+   if (bRecordGraph)
+      Layers_.Allocate(EDungeonLayer::DL_RegionId);
+
+   Used_.Init(Storage == ETileStorage::TS_Bytes ? XSize : 0, Storage == ETileStorage::TS_Bytes ? YSize : 0);
+
+   // Only accretion picks anchors, the other layouts carve without keeping the frontier current.
+   Anchors_.clear();
+   AnchorSlots_.Reset();
+   bTrackAnchors_ = Sampling == EFeatureSampling::FS_Frontier && Algorithm == EDungeonAlgorithm::DA_Accretion;
+
+   Stats_ = FDungeonStats();
+   rnd_.SetSeed(uint32(Seed), Stream);
+}
+
+void FDungeonGenerator::Generate()
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonGenerate);
+   FDungeonCounterTimer Timer(EDungeonCounter::GenerateMicroseconds);
+
+   Reset();
+   MakeDungeon();
+
+   if (Layers_.EntranceDistance.IsAllocated())
+      ComputeEntranceDistance();
+
+   FDungeonCounters::AddGeneratorStats(Stats_);
+}
+
+void FDungeonGenerator::SetCell(int32 x, int32 y, ETileType celltype)
+{
+   if (Storage == ETileStorage::TS_BitPlanes)
+   {
+      for (auto plane = 0; plane != NumPlanes; ++plane)
+         Planes_[plane].Set(x, y, (int32(celltype) >> plane) & 1);
+   }
+   else
+   {
+      Data_[x + XSize * y] = celltype;
+      Used_.Set(x, y, celltype != ETileType::TE_Unused);
+   }
+
+   if (bTrackAnchors_)
+      UpdateAnchors(x, y, x, y);
+}
+
+ETileType FDungeonGenerator::GetCell(int32 x, int32 y) const
+{
+   if (Storage == ETileStorage::TS_BitPlanes)
+      return ETileType(int32(Planes_[0].Get(x, y)) | (int32(Planes_[1].Get(x, y)) << 1) | (int32(Planes_[2].Get(x, y)) << 2));
+
+   return Data_[x + XSize * y];
+}
+
+void FDungeonGenerator::SetCells(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, ETileType cellType)
+{
+   if (xStart > xEnd || yStart > yEnd)
+      return;
+
+   if (Storage == ETileStorage::TS_BitPlanes)
+   {
+      for (auto plane = 0; plane != NumPlanes; ++plane)
+         Planes_[plane].SetRect(xStart, yStart, xEnd, yEnd, (int32(cellType) >> plane) & 1);
+   }
+   else
+   {
+      for (auto y = yStart; y != yEnd + 1; ++y)
+         std::fill(Data_.begin() + xStart + XSize * y, Data_.begin() + xEnd + 1 + XSize * y, cellType);
+
+      Used_.SetRect(xStart, yStart, xEnd, yEnd, cellType != ETileType::TE_Unused);
+   }
+
+   if (bTrackAnchors_)
+      UpdateAnchors(xStart, yStart, xEnd, yEnd);
+}
+
+void FDungeonGenerator::SetCells(const FDungeonBitGrid& Floor, const FDungeonBitGrid& Wall)
+{
+   check(Floor.GetXSize() == XSize && Floor.GetYSize() == YSize && Wall.GetXSize() == XSize && Wall.GetYSize() == YSize);
+
+   // Floor wins where both are set, like the byte rows below.
+   static_assert(int32(ETileType::TE_DirtWall) == 1 && int32(ETileType::TE_DirtFloor) == 2, "Wall and floor are the two low planes");
+
+   if (Storage == ETileStorage::TS_BitPlanes)
+   {
+      Planes_[0] = Wall;
+      Planes_[0].AndNot(Floor);
+      Planes_[1] = Floor;
+      Planes_[2].Init(XSize, YSize);
+   }
+   else
+   {
+      ParallelFor(YSize, [this, &Floor, &Wall](int32 y)
+      {
+         const uint64* FloorRow = Floor.GetRow(y);
+         const uint64* WallRow = Wall.GetRow(y);
+         ETileType* Out = &Data_[XSize * y];
+
+         for (auto x = 0; x != XSize; ++x)
+         {
+            const auto Bit = x & 63;
+            Out[x] = (FloorRow[x >> 6] >> Bit) & 1 ? ETileType::TE_DirtFloor :
+               (WallRow[x >> 6] >> Bit) & 1 ? ETileType::TE_DirtWall : ETileType::TE_Unused;
+         }
+      }, XSize * YSize < MinParallelCells);
+
+      Used_ = Floor;
+      Used_.Or(Wall);
+   }
+
+   if (bTrackAnchors_)
+      UpdateAnchors(0, 0, XSize - 1, YSize - 1);
+}
+
+bool FDungeonGenerator::IsXInBounds(int32 x) const
+{
+   return x >= 0 && x < XSize;
+}
+
+bool FDungeonGenerator::IsYInBounds(int32 y) const
+{
+   return y >= 0 && y < YSize;
+}
+
+bool FDungeonGenerator::IsAreaUnused(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd) const
+{
+   if (Storage == ETileStorage::TS_BitPlanes)
+   {
+      for (const auto& Plane : Planes_)
+         if (Plane.AnyInRect(xStart, yStart, xEnd, yEnd))
+            return false;
+
+      return true;
+   }
+
+   return !Used_.AnyInRect(xStart, yStart, xEnd, yEnd);
+}
+
+bool FDungeonGenerator::IsAdjacent(int32 x, int32 y, ETileType tile) const
+{
+   return
+      GetCell(x - 1, y) == tile || GetCell(x + 1, y) == tile ||
+      GetCell(x, y - 1) == tile || GetCell(x, y + 1) == tile;
+}
+
+void FDungeonGenerator::GetTiles(uint32 TileMask, FDungeonBitGrid& Out) const
+{
+   check(Storage == ETileStorage::TS_BitPlanes);
+
+   Out.Init(XSize, YSize);
+
+   const auto W = Out.GetWordsPerRow();
+   const uint64 Tail = Out.TailMask();
+
+   for (auto y = 0; y != YSize; ++y)
+   {
+      const uint64* Low = Planes_[0].GetRow(y);
+      const uint64* Mid = Planes_[1].GetRow(y);
+      const uint64* High = Planes_[2].GetRow(y);
+      uint64* Row = Out.GetRow(y);
+
+      for (auto w = 0; w != W; ++w)
+      {
+         // One minterm of the three planes per requested type.
+         uint64 Bits = 0;
+         for (auto tile = 0; tile != 8; ++tile)
+            if (TileMask & (1u << tile))
+               Bits |= (tile & 1 ? Low[w] : ~Low[w]) & (tile & 2 ? Mid[w] : ~Mid[w]) & (tile & 4 ? High[w] : ~High[w]);
+
+         Row[w] = Bits;
+      }
+
+      Row[W - 1] &= Tail;
+   }
+}
+
+void FDungeonGenerator::GetWalkable(FDungeonBitGrid& Out) const
+{
+   // Walls are 1 and unused tiles 0, every walkable type has one of the two high bits set.
+   if (Storage == ETileStorage::TS_BitPlanes)
+   {
+      Out = Planes_[1];
+      Out.Or(Planes_[2]);
+      return;
+   }
+
+   Out.Init(XSize, YSize);
+
+   for (auto y = 0; y != YSize; ++y)
+      for (auto x = 0; x != XSize; ++x)
+         if (GetCell(x, y) != ETileType::TE_Unused && GetCell(x, y) != ETileType::TE_DirtWall)
+            Out.Set(x, y, true);
+}
+
+void FDungeonGenerator::SetCellMeta(int32 x, int32 y, FTileMeta celltype)
+{
+   Layers_.Direction.Set(x, y, celltype.dir);
+}
+
+FTileMeta FDungeonGenerator::GetCellMeta(int32 x, int32 y) const
+{
+   FTileMeta Meta;
+   Meta.dir = Layers_.Direction.Get(x, y);
+   return Meta;
+}
+
+int32 FDungeonGenerator::GetRandomInt(int32 min, int32 max)
+{
+   return rnd_.Range(min, max);
+}
+
+EDirection FDungeonGenerator::GetRandomDirection()
+{
+   return EDirection(rnd_.Range(0, 3));
+}
+
+bool FDungeonGenerator::FindTile(ETileType tile, FIntPoint& OutTile) const
+{
+   for (auto y = 0; y != YSize; ++y)
+   {
+      for (auto x = 0; x != XSize; ++x)
+      {
+         if (GetCell(x, y) == tile)
+         {
+            OutTile = FIntPoint(x, y);
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+RngT FDungeonGenerator::GetSubstream(uint64 Id) const
+{
+   return RngT(uint32(Seed), RngT::Mix(Stream) ^ RngT::Mix(~Id));
+}
+
+bool FDungeonGenerator::MakeCorridor(int32 x, int32 y, int32 maxLength, EDirection direction)
+{
+   auto length = GetRandomInt(2, maxLength);
+
+   auto xStart = x;
+   auto yStart = y;
+
+   auto xEnd = x;
+   auto yEnd = y;
+
+   if (direction == EDirection::DE_North)
+      yStart = y - length;
+   else if (direction == EDirection::DE_East)
+      xEnd = x + length;
+   else if (direction == EDirection::DE_South)
+      yEnd = y + length;
+   else if (direction == EDirection::DE_West)
+      xStart = x - length;
+
+   if (!IsXInBounds(xStart) || !IsXInBounds(xEnd) || !IsYInBounds(yStart) || !IsYInBounds(yEnd))
+   {
+      ++Stats_.RejectedBounds;
+      return false;
+   }
+
+   if (!IsAreaUnused(xStart, yStart, xEnd, yEnd))
+   {
+      ++Stats_.RejectedArea;
+      return false;
+   }
+
+   AddCorridor(xStart, yStart, xEnd, yEnd);
+   return true;
+}
+
+bool FDungeonGenerator::MakeRoom(int32 x, int32 y, int32 xMaxLength, int32 yMaxLength, EDirection direction)
+{
+   // Minimum room size of 4x4 tiles (2x2 for walking on, the rest is walls)
+   auto xLength = GetRandomInt(4, xMaxLength);
+   auto yLength = GetRandomInt(4, yMaxLength);
+
+   auto xStart = x;
+   auto yStart = y;
+
+   auto xEnd = x;
+   auto yEnd = y;
+
+   if (direction == EDirection::DE_North)
+   {
+      yStart = y - yLength;
+      xStart = x - xLength / 2;
+      xEnd = x + (xLength + 1) / 2;
+   }
+   else if (direction == EDirection::DE_East)
+   {
+      yStart = y - yLength / 2;
+      yEnd = y + (yLength + 1) / 2;
+      xEnd = x + xLength;
+   }
+   else if (direction == EDirection::DE_South)
+   {
+      yEnd = y + yLength;
+      xStart = x - xLength / 2;
+      xEnd = x + (xLength + 1) / 2;
+   }
+   else if (direction == EDirection::DE_West)
+   {
+      yStart = y - yLength / 2;
+      yEnd = y + (yLength + 1) / 2;
+      xStart = x - xLength;
+   }
+
+   if (!IsXInBounds(xStart) || !IsXInBounds(xEnd) || !IsYInBounds(yStart) || !IsYInBounds(yEnd))
+   {
+      ++Stats_.RejectedBounds;
+      return false;
+   }
+
+   if (!IsAreaUnused(xStart, yStart, xEnd, yEnd))
+   {
+      ++Stats_.RejectedArea;
+      return false;
+   }
+
+   AddRoom(xStart, yStart, xEnd, yEnd);
+   return true;
+}
+
+int32 FDungeonGenerator::AddRoom(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd)
+{
+   SetCells(xStart, yStart, xEnd, yEnd, ETileType::TE_DirtWall);
+   SetCells(xStart + 1, yStart + 1, xEnd - 1, yEnd - 1, ETileType::TE_DirtFloor);
+
+   const auto Region = AddRegion(xStart, yStart, xEnd, yEnd, true);
+
+   // Walls are left out, they are shared with whatever is built next to the room.
+   if (Layers_.RoomId.IsAllocated())
+      Layers_.RoomId.SetRect(xStart + 1, yStart + 1, xEnd - 1, yEnd - 1, Stats_.Rooms);
+   if (Layers_.RegionId.IsAllocated())
+      Layers_.RegionId.SetRect(xStart + 1, yStart + 1, xEnd - 1, yEnd - 1, Region);
+
+   return Region;
+}
+
+int32 FDungeonGenerator::AddCorridor(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd)
+{
+   SetCells(xStart, yStart, xEnd, yEnd, ETileType::TE_Corridor);
+
+   const auto Region = AddRegion(xStart, yStart, xEnd, yEnd, false);
+
+   if (Layers_.RegionId.IsAllocated())
+      Layers_.RegionId.SetRect(xStart, yStart, xEnd, yEnd, Region);
+
+   return Region;
+}
+
+int32 FDungeonGenerator::AddRegion(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, bool bRoom)
+{
+   ++(bRoom ? Stats_.Rooms : Stats_.Corridors);
+
+   if (bRecordGraph)
+      Graph_.AddRegion(FDungeonRegion(FIntPoint(xStart, yStart), FIntPoint(xEnd, yEnd), bRoom));
+
+   return Stats_.Rooms + Stats_.Corridors;
+}
+
+bool FDungeonGenerator::MakeFeature(int32 x, int32 y, int32 xmod, int32 ymod, EDirection direction)
+{
+   // Choose what to build
+   auto chance = GetRandomInt(0, 100);
+
+   if (chance <= ChanceRoom)
+   {
+      if (MakeRoom(x + xmod, y + ymod, 8, 6, direction))
+      {
+         SetCell(x, y, ETileType::TE_Door);
+
+         // Remove wall next to the door.
+         SetCell(x + xmod, y + ymod, ETileType::TE_DirtFloor);
+         Layers_.RoomId.Set(x + xmod, y + ymod, Layers_.RoomId.Get(x + 2 * xmod, y + 2 * ymod));
+         Layers_.RegionId.Set(x + xmod, y + ymod, Layers_.RegionId.Get(x + 2 * xmod, y + 2 * ymod));
+
+         AddDoor(x, y, xmod, ymod);
+         return true;
+      }
+
+      return false;
+   }
+   else
+   {
+      if (MakeCorridor(x + xmod, y + ymod, 6, direction))
+      {
+         SetCell(x, y, ETileType::TE_Door);
+
+         AddDoor(x, y, xmod, ymod);
+         return true;
+      }
+
+      return false;
+   }
+}
+
+bool FDungeonGenerator::MakeFeature()
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonMakeFeature);
+
+   auto tries = 0;
+   auto maxTries = 1000;
+
+   for (; tries != maxTries; ++tries)
+   {
+      // Pick a random wall or corridor tile.
+      // Make sure it has no adjacent doors (looks weird to have doors next to each other).
+      // Find a direction from which it's reachable.
+      // Attempt to make a feature (room or corridor) starting at this point.
+      // With frontier sampling only tiles passing these checks are ever picked.
+
+      int x;
+      int y;
+
+      if (Sampling == EFeatureSampling::FS_Frontier)
+      {
+         if (Anchors_.empty())
+            return false;
+
+         const auto cell = Anchors_[GetRandomInt(0, int32(Anchors_.size()) - 1)];
+         x = cell % XSize;
+         y = cell / XSize;
+      }
+      else
+      {
+         x = GetRandomInt(1, XSize - 2);
+         y = GetRandomInt(1, YSize - 2);
+      }
+
+      int32 xmod;
+      int32 ymod;
+      EDirection direction;
+
+      if (!GetAnchor(x, y, xmod, ymod, direction))
+      {
+         // Only tiles that pass the wall or corridor check can be rejected for a door.
+         const auto tile = GetCell(x, y);
+         if ((tile == ETileType::TE_DirtWall || tile == ETileType::TE_Corridor) && IsAdjacent(x, y, ETileType::TE_Door))
+            ++Stats_.RejectedDoor;
+         else
+            ++Stats_.RejectedTile;
+      }
+      else if (MakeFeature(x, y, xmod, ymod, direction))
+      {
+         return true;
+      }
+
+      ++Stats_.FailedTries;
+   }
+
+   return false;
+}
+
+bool FDungeonGenerator::GetAnchor(int32 x, int32 y, int32& xmod, int32& ymod, EDirection& direction) const
+{
+   if (GetCell(x, y) != ETileType::TE_DirtWall && GetCell(x, y) != ETileType::TE_Corridor)
+      return false;
+
+   if (IsAdjacent(x, y, ETileType::TE_Door))
+      return false;
+
+   auto IsOpen = [this](int32 xn, int32 yn)
+   {
+      return GetCell(xn, yn) == ETileType::TE_DirtFloor || GetCell(xn, yn) == ETileType::TE_Corridor;
+   };
+
+   if (IsOpen(x, y + 1))
+   {
+      xmod = 0; ymod = -1; direction = EDirection::DE_North;
+   }
+   else if (IsOpen(x - 1, y))
+   {
+      xmod = 1; ymod = 0; direction = EDirection::DE_East;
+   }
+   else if (IsOpen(x, y - 1))
+   {
+      xmod = 0; ymod = 1; direction = EDirection::DE_South;
+   }
+   else if (IsOpen(x + 1, y))
+   {
+      xmod = -1; ymod = 0; direction = EDirection::DE_West;
+   }
+   else
+   {
+      return false;
+   }
+
+   return true;
+}
+
+void FDungeonGenerator::UpdateAnchors(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd)
+{
+   // An anchor depends on its own tile and its four neighbours, and has to stay off the map border.
+   xStart = FMath::Max(xStart - 1, 1);
+   yStart = FMath::Max(yStart - 1, 1);
+   xEnd = FMath::Min(xEnd + 1, XSize - 2);
+   yEnd = FMath::Min(yEnd + 1, YSize - 2);
+
+   for (auto y = yStart; y <= yEnd; ++y)
+   {
+      for (auto x = xStart; x <= xEnd; ++x)
+      {
+         const auto cell = x + XSize * y;
+         const auto slot = AnchorSlots_.Find(cell);
+
+         int32 xmod;
+         int32 ymod;
+         EDirection direction;
+         const bool bValid = GetAnchor(x, y, xmod, ymod, direction);
+
+         if (bValid && slot < 0)
+         {
+            AnchorSlots_.Set(cell, int32(Anchors_.size()));
+            Anchors_.push_back(cell);
+         }
+         else if (!bValid && slot >= 0)
+         {
+            const auto last = Anchors_.back();
+            Anchors_[slot] = last;
+            AnchorSlots_.Set(last, slot);
+            Anchors_.pop_back();
+            AnchorSlots_.Remove(cell);
+         }
+      }
+   }
+}
+
+void FDungeonGenerator::FAnchorSlots::Reset()
+{
+   for (auto& Entry : Entries_)
+      Entry.Cell = -1;
+
+   Num_ = 0;
+}
+
+int32 FDungeonGenerator::FAnchorSlots::Find(int32 Cell) const
+{
+   if (Entries_.empty())
+      return -1;
+
+   const uint32 Mask = uint32(Entries_.size()) - 1;
+   for (auto i = Home(Cell); ; i = (i + 1) & Mask)
+   {
+      if (Entries_[i].Cell == Cell)
+         return Entries_[i].Slot;
+      if (Entries_[i].Cell < 0)
+         return -1;
+   }
+}
+
+void FDungeonGenerator::FAnchorSlots::Set(int32 Cell, int32 Slot)
+{
+   // At most three quarters full, so probes stay short and always find a free entry.
+   if (4 * (Num_ + 1) > 3 * int32(Entries_.size()))
+      Grow();
+
+   const uint32 Mask = uint32(Entries_.size()) - 1;
+   auto i = Home(Cell);
+   while (Entries_[i].Cell >= 0 && Entries_[i].Cell != Cell)
+      i = (i + 1) & Mask;
+
+   if (Entries_[i].Cell < 0)
+      ++Num_;
+
+   Entries_[i].Cell = Cell;
+   Entries_[i].Slot = Slot;
+}
+
+void FDungeonGenerator::FAnchorSlots::Remove(int32 Cell)
+{
+   if (Entries_.empty())
+      return;
+
+   const uint32 Mask = uint32(Entries_.size()) - 1;
+   auto i = Home(Cell);
+   while (Entries_[i].Cell != Cell)
+   {
+      if (Entries_[i].Cell < 0)
+         return;
+      i = (i + 1) & Mask;
+   }
+
+   // Backward shift: entries after the hole move up unless their home lies cyclically in (hole, entry].
+   for (auto j = (i + 1) & Mask; Entries_[j].Cell >= 0; j = (j + 1) & Mask)
+   {
+      const auto k = Home(Entries_[j].Cell);
+      if (((j - k) & Mask) >= ((j - i) & Mask))
+      {
+         Entries_[i] = Entries_[j];
+         i = j;
+      }
+   }
+
+   Entries_[i].Cell = -1;
+   --Num_;
+}
+
+void FDungeonGenerator::FAnchorSlots::Grow()
+{
+   std::vector<FEntry> Old;
+   Old.swap(Entries_);
+
+   const auto Capacity = FMath::Max(int32(Old.size()) * 2, 256);
+   Entries_.assign(Capacity, FEntry{ -1, -1 });
+   Shift_ = 32 - FMath::FloorLog2(uint32(Capacity));
+   Num_ = 0;
+
+   for (const auto& Entry : Old)
+      if (Entry.Cell >= 0)
+         Set(Entry.Cell, Entry.Slot);
+}
+
+int64 FDungeonGenerator::GetGridAllocatedSize() const
+{
+   auto Size = int64(Data_.capacity()) * sizeof(ETileType) + Used_.GetAllocatedSize() +
+      int64(Anchors_.capacity()) * sizeof(int32) + AnchorSlots_.GetAllocatedSize();
+
+   for (const auto& Plane : Planes_)
+      Size += Plane.GetAllocatedSize();
+
+   return Size;
+}
+
+int32 FDungeonGenerator::MakeFeatures(int32 Count)
+{
+   auto features = 0;
+
+   for (; features != Count; ++features)
+   {
+      if (IsCancelled() || !MakeFeature())
+         break;
+   }
+
+   Stats_.FeaturesPlaced += features;
+
+   return features;
+}
+
+bool FDungeonGenerator::MakeStairs(ETileType tile)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonMakeStairs);
+
+   auto tries = 0;
+   auto maxTries = 10000;
+
+   if (IsCancelled())
+      return false;
+
+   // With bit planes the adjacency checks of all tries collapse into one candidate mask built from whole words.
+   const bool bMask = Storage == ETileStorage::TS_BitPlanes;
+
+   if (bMask)
+   {
+      GetTiles((1u << int32(ETileType::TE_DirtFloor)) | (1u << int32(ETileType::TE_Corridor)), Tiles_);
+      Candidates_.SetAdjacent(Tiles_);
+      GetTiles(1u << int32(ETileType::TE_Door), Tiles_);
+      Scratch_.SetAdjacent(Tiles_);
+      Candidates_.AndNot(Scratch_);
+   }
+
+   for (; tries != maxTries; ++tries)
+   {
+      int x = GetRandomInt(1, XSize - 2);
+      int y = GetRandomInt(1, YSize - 2);
+
+      if (bMask)
+      {
+         if (!Candidates_.Get(x, y))
+            continue;
+      }
+      else
+      {
+         if (!IsAdjacent(x, y, ETileType::TE_DirtFloor) && !IsAdjacent(x, y, ETileType::TE_Corridor))
+            continue;
+
+         if (IsAdjacent(x, y, ETileType::TE_Door))
+            continue;
+      }
+
+      SetCell(x, y, tile);
+      Stats_.StairTries += tries + 1;
+
+      if (bRecordGraph)
+      {
+         // Stairs may replace a wall or an unused tile, they belong to the region they are reached from.
+         auto Region = Layers_.RegionId.Get(x, y);
+         const FIntPoint Neighbours[] = { FIntPoint(x, y - 1), FIntPoint(x + 1, y), FIntPoint(x, y + 1), FIntPoint(x - 1, y) };
+         for (const FIntPoint& Next : Neighbours)
+            if (!Region)
+               Region = Layers_.RegionId.Get(Next.X, Next.Y);
+
+         (tile == ETileType::TE_UpStairs ? Graph_.UpStairsRegion : Graph_.DownStairsRegion) = Region - 1;
+      }
+
+      return true;
+   }
+
+   Stats_.StairTries += tries;
+
+   return false;
+}
+
+void FDungeonGenerator::AddDoor(int32 x, int32 y, int32 xmod, int32 ymod)
+{
+   if (!bRecordGraph)
+      return;
+
+   // A door cut into a corridor keeps the corridor's region, one cut into a wall leads to the floor behind it.
+   auto From = Layers_.RegionId.Get(x, y);
+   if (!From)
+      From = Layers_.RegionId.Get(x - xmod, y - ymod);
+
+   if (From)
+      Graph_.AddDoor(FDungeonDoor(FIntPoint(x, y), From - 1, Graph_.NumRegions() - 1));
+}
+
+void FDungeonGenerator::AddDoor(const FIntPoint& Tile, int32 FromRegion, int32 ToRegion)
+{
+   if (bRecordGraph && FromRegion > 0 && ToRegion > 0)
+      Graph_.AddDoor(FDungeonDoor(Tile, FromRegion - 1, ToRegion - 1));
+}
+
+void FDungeonGenerator::ComputeEntranceDistance()
+{
+   auto* Distance = Layers_.EntranceDistance.Allocate();
+   Layers_.EntranceDistance.Fill(MAX_int32);
+
+   FIntPoint Start;
+   if (!FindTile(ETileType::TE_UpStairs, Start))
+      return;
+
+   auto IsWalkable = [this](int32 x, int32 y)
+   {
+      const auto tile = GetCell(x, y);
+      return tile != ETileType::TE_Unused && tile != ETileType::TE_DirtWall;
+   };
+
+   // Unit step costs, the queue is in distance order without a heap.
+   auto& Queue = DistanceQueue_;
+   Queue.clear();
+   Queue.push_back(Start.X + XSize * Start.Y);
+   Distance[Queue[0]] = 0;
+
+   for (size_t Head = 0; Head != Queue.size(); ++Head)
+   {
+      const auto cell = Queue[Head];
+      const auto x = cell % XSize;
+      const auto y = cell / XSize;
+
+      const FIntPoint Neighbours[] = { FIntPoint(x, y - 1), FIntPoint(x + 1, y), FIntPoint(x, y + 1), FIntPoint(x - 1, y) };
+      for (const FIntPoint& Next : Neighbours)
+      {
+         if (!IsXInBounds(Next.X) || !IsYInBounds(Next.Y) || !IsWalkable(Next.X, Next.Y))
+            continue;
+
+         const auto next = Next.X + XSize * Next.Y;
+         if (Distance[next] != MAX_int32)
+            continue;
+
+         Distance[next] = Distance[cell] + 1;
+         Queue.push_back(next);
+      }
+   }
+}
+
+bool FDungeonGenerator::MakeDungeon()
+{
+   switch (Algorithm)
+   {
+   case EDungeonAlgorithm::DA_BSP:
+      return MakeDungeon(Bsp_);
+   case EDungeonAlgorithm::DA_Drunkard:
+      return MakeDungeon(Drunkard_);
+   case EDungeonAlgorithm::DA_Cellular:
+      return MakeDungeon(Cellular_);
+   default:
+      return MakeDungeon(Accretion_);
+   }
+}
+
+template <typename PolicyType>
+bool FDungeonGenerator::MakeDungeon(PolicyType& Policy)
+{
+   Policy.Layout(*this);
+
+   Stats_.bUpStairs = MakeStairs(ETileType::TE_UpStairs);
+   if (!Stats_.bUpStairs) {
+      // std::cout << "Unable to place up stairs." << std::endl;
+   }
+
+
+   Stats_.bDownStairs = MakeStairs(ETileType::TE_DownStairs);
+   if (!Stats_.bDownStairs) {
+      // std::cout << "Unable to place down stairs." << std::endl;
+   }
+
+   return true;
+}
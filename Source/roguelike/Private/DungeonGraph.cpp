@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonGraph.h"
+
+FDungeonGraph::FDungeonGraph()
+   : UpStairsRegion(-1)
+   , DownStairsRegion(-1)
+{
+}
+
+void FDungeonGraph::Reset()
+{
+   UpStairsRegion = -1;
+   DownStairsRegion = -1;
+
+   Regions_.clear();
+   Doors_.clear();
+   FirstLink_.clear();
+   LastLink_.clear();
+   NextLink_.clear();
+}
+
+int32 FDungeonGraph::AddRegion(const FDungeonRegion& Region)
+{
+   Regions_.push_back(Region);
+   FirstLink_.push_back(-1);
+   LastLink_.push_back(-1);
+
+   return NumRegions() - 1;
+}
+
+void FDungeonGraph::AddDoor(const FDungeonDoor& Door)
+{
+   check(Door.From >= 0 && Door.From < NumRegions() && Door.To >= 0 && Door.To < NumRegions());
+
+   const auto Link = int32(NextLink_.size());
+   NextLink_.push_back(-1);
+   NextLink_.push_back(-1);
+   Doors_.push_back(Door);
+
+   // Appended at the tail, the lists stay in the order the doors were cut.
+   const int32 Regions[] = { Door.From, Door.To };
+   for (auto Side = 0; Side != 2; ++Side)
+   {
+      int32& Last = LastLink_[Regions[Side]];
+      if (Last < 0)
+         FirstLink_[Regions[Side]] = Link + Side;
+      else
+         NextLink_[Last] = Link + Side;
+      Last = Link + Side;
+   }
+}
+
+int32 FDungeonGraph::FindRegion(int32 x, int32 y) const
+{
+   for (auto i = 0; i != NumRegions(); ++i)
+      if (Regions_[i].Contains(x, y))
+         return i;
+
+   return -1;
+}
+
+template <typename FunctionType>
+void FDungeonGraph::Search(int32 Start, FunctionType Visit) const
+{
+   if (Start < 0 || Start >= NumRegions())
+      return;
+
+   std::vector<int32> Hops(Regions_.size(), -1);
+   std::vector<int32> Queue;
+   Queue.reserve(Regions_.size());
+
+   Hops[Start] = 0;
+   Queue.push_back(Start);
+
+   for (size_t Head = 0; Head != Queue.size(); ++Head)
+   {
+      const auto Region = Queue[Head];
+      if (!Visit(Region, Hops[Region]))
+         return;
+
+      ForEachDoor(Region, [this, Region, &Hops, &Queue](int32 DoorIndex)
+      {
+         const FDungeonDoor& Door = Doors_[DoorIndex];
+         const auto Next = Door.From == Region ? Door.To : Door.From;
+
+         if (Hops[Next] < 0)
+         {
+            Hops[Next] = Hops[Region] + 1;
+            Queue.push_back(Next);
+         }
+      });
+   }
+}
+
+void FDungeonGraph::GetHops(int32 Start, std::vector<int32>& OutHops) const
+{
+   OutHops.assign(Regions_.size(), -1);
+
+   Search(Start, [&OutHops](int32 Region, int32 Hops)
+   {
+      OutHops[Region] = Hops;
+      return true;
+   });
+}
+
+void FDungeonGraph::GetRegionsWithinHops(int32 Start, int32 MaxHops, bool bRoomsOnly, std::vector<int32>& OutRegions) const
+{
+   OutRegions.clear();
+
+   // Regions come in order of their distance, the first one too far ends the search.
+   Search(Start, [this, MaxHops, bRoomsOnly, &OutRegions](int32 Region, int32 Hops)
+   {
+      if (Hops > MaxHops)
+         return false;
+
+      if (!bRoomsOnly || Regions_[Region].bRoom)
+         OutRegions.push_back(Region);
+      return true;
+   });
+}
+
+int32 FDungeonGraph::FindFarthestRoom(int32 Start) const
+{
+   int32 Farthest = -1;
+
+   Search(Start, [this, &Farthest](int32 Region, int32 Hops)
+   {
+      if (Regions_[Region].bRoom)
+         Farthest = Region;
+      return true;
+   });
+
+   return Farthest;
+}
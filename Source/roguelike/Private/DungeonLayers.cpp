@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonLayers.h"
+
+FDungeonLayers::FDungeonLayers()
+   : EntranceDistance(MAX_int32)
+{
+}
+
+void FDungeonLayers::Resize(int32 XSize, int32 YSize)
+{
+   Direction.Resize(XSize, YSize);
+   RoomId.Resize(XSize, YSize);
+   RegionId.Resize(XSize, YSize);
+   EntranceDistance.Resize(XSize, YSize);
+   Light.Resize(XSize, YSize);
+   Explored.Resize(XSize, YSize);
+}
+
+void FDungeonLayers::Release()
+{
+   Direction.Release();
+   RoomId.Release();
+   RegionId.Release();
+   EntranceDistance.Release();
+   Light.Release();
+   Explored.Release();
+}
+
+bool FDungeonLayers::IsAllocated(EDungeonLayer Layer) const
+{
+   switch (Layer)
+   {
+   case EDungeonLayer::DL_Direction: return Direction.IsAllocated();
+   case EDungeonLayer::DL_RoomId: return RoomId.IsAllocated();
+   case EDungeonLayer::DL_RegionId: return RegionId.IsAllocated();
+   case EDungeonLayer::DL_EntranceDistance: return EntranceDistance.IsAllocated();
+   case EDungeonLayer::DL_Light: return Light.IsAllocated();
+   case EDungeonLayer::DL_Explored: return Explored.IsAllocated();
+   }
+
+   return false;
+}
+
+void FDungeonLayers::Allocate(EDungeonLayer Layer)
+{
+   switch (Layer)
+   {
+   case EDungeonLayer::DL_Direction: Direction.Allocate(); break;
+   case EDungeonLayer::DL_RoomId: RoomId.Allocate(); break;
+   case EDungeonLayer::DL_RegionId: RegionId.Allocate(); break;
+   case EDungeonLayer::DL_EntranceDistance: EntranceDistance.Allocate(); break;
+   case EDungeonLayer::DL_Light: Light.Allocate(); break;
+   case EDungeonLayer::DL_Explored: Explored.Allocate(); break;
+   }
+}
+
+int32 FDungeonLayers::GetValue(EDungeonLayer Layer, int32 x, int32 y) const
+{
+   switch (Layer)
+   {
+   case EDungeonLayer::DL_Direction: return int32(Direction.Get(x, y));
+   case EDungeonLayer::DL_RoomId: return RoomId.Get(x, y);
+   case EDungeonLayer::DL_RegionId: return RegionId.Get(x, y);
+   case EDungeonLayer::DL_EntranceDistance: return EntranceDistance.Get(x, y);
+   case EDungeonLayer::DL_Light: return Light.Get(x, y);
+   case EDungeonLayer::DL_Explored: return Explored.Get(x, y);
+   }
+
+   return 0;
+}
+
+void FDungeonLayers::SetValue(EDungeonLayer Layer, int32 x, int32 y, int32 Value)
+{
+   switch (Layer)
+   {
+   case EDungeonLayer::DL_Direction: Direction.Set(x, y, EDirection(FMath::Clamp(Value, 0, int32(EDirection::DE_SouthEast)))); break;
+   case EDungeonLayer::DL_RoomId: RoomId.Set(x, y, Value); break;
+   case EDungeonLayer::DL_RegionId: RegionId.Set(x, y, Value); break;
+   case EDungeonLayer::DL_EntranceDistance: EntranceDistance.Set(x, y, Value); break;
+   case EDungeonLayer::DL_Light: Light.Set(x, y, uint8(FMath::Clamp(Value, 0, 255))); break;
+   case EDungeonLayer::DL_Explored: Explored.Set(x, y, Value != 0); break;
+   }
+}
+
+int64 FDungeonLayers::GetAllocatedSize() const
+{
+   return Direction.GetAllocatedSize() + RoomId.GetAllocatedSize() + RegionId.GetAllocatedSize() +
+      EntranceDistance.GetAllocatedSize() + Light.GetAllocatedSize() + Explored.GetAllocatedSize();
+}
@@ -2,6 +2,61 @@
 
 #include "DungeonMapActor.h"
 #include "Materials/MaterialInstanceDynamic.h"
+#include "Kismet/GameplayStatics.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Async/ParallelFor.h"
+#include "Async/Async.h"
+#include "AI/Navigation/NavigationSystem.h"
+#include "Misc/ScopeExit.h"
+#include "Serialization/CustomVersion.h"
+#include "DungeonMapFile.h"
+#include "DungeonProfiling.h"
+#include "roguelike.h"
+
+#include <algorithm>
+#include <random>
+
+DECLARE_CYCLE_STAT(TEXT("Build"), STAT_DungeonBuild, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Build instances"), STAT_DungeonBuildInstances, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Update streaming"), STAT_DungeonUpdateStreaming, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Load chunk"), STAT_DungeonLoadChunk, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Find path"), STAT_DungeonFindPath, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Field of view"), STAT_DungeonFieldOfView, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Change floor"), STAT_DungeonChangeFloor, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Flow field"), STAT_DungeonFlowField, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Entity turns"), STAT_DungeonEntityTurns, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Entity visuals"), STAT_DungeonEntityVisuals, STATGROUP_Dungeon);
+
+static const FName PlayerFlowField(TEXT("Player"));
+static const FName FleeFlowField(TEXT("Flee"));
+
+// Uniform scale applied to every tile mesh
+static const float TileScale = 10.0f;
+
+// Side of the square blocks walls are merged in, a tile change re-merges one to four blocks
+static const int32 MergeBlockTiles = 32;
+
+// Generator substream of random entity placement, apart from the streams the map is generated from
+static const uint64 EntitySubstream = 0x454E54;
+
+// Versions of the data ADungeonMapActor::Serialize() writes after the properties
+struct FDungeonMapActorVersion
+{
+   enum Type
+   {
+      BeforeCustomVersion = 0,
+      // Built map as an FDungeonMapFile blob, empty unless bSaveMap is set
+      SavedMap,
+
+      VersionPlusOne,
+      LatestVersion = VersionPlusOne - 1
+   };
+
+   static const FGuid GUID;
+};
+
+const FGuid FDungeonMapActorVersion::GUID(0x6A3C1F52, 0x9D4B4E27, 0xB2E8C5D1, 0x47F0A39E);
+static FCustomVersionRegistration GRegisterDungeonMapActorVersion(FDungeonMapActorVersion::GUID, FDungeonMapActorVersion::LatestVersion, TEXT("DungeonMapActor"));
 
 // Sets default values
 ADungeonMapActor::ADungeonMapActor()
@@ -15,6 +70,59 @@ ADungeonMapActor::ADungeonMapActor()
    MaxFeatures = 100;
    ChanceRoom = 75;
    ChanceCorridor = 25;
+   FeatureSampling = EFeatureSampling::FS_Frontier;
+   TileStorage = ETileStorage::TS_Bytes;
+   Algorithm = EDungeonAlgorithm::DA_Accretion;
+   CaveIterations = 5;
+   GeneratedLayers = 0;
+   bRecordGraph = false;
+   bAsyncGeneration = false;
+   bSaveMap = false;
+
+   bFogOfWar = false;
+   ViewRadius = 20;
+
+   bPlayerFlowFields = false;
+   FlowFieldRadius = 0;
+   FleeCoefficient = 1.2f;
+
+   bHierarchicalInstancing = false;
+   InstanceChunkSize = 64;
+   InstanceStartCullDistance = 0;
+   InstanceEndCullDistance = 0;
+   bMergeWalls = false;
+   MergedWallMaterial = nullptr;
+
+   bMultiFloor = false;
+   PrefetchDistance = 8;
+   FloorCacheSize = 4;
+   CurrentFloor = 0;
+
+   bEndless = false;
+   ChunkSize = 32;
+   ChunkMargin = 8;
+   ChunkMaxFeatures = 20;
+   StreamRadius = 2;
+   ChunksPerTick = 1;
+
+   LastBuildMilliseconds = 0.0f;
+   BuiltXSize_ = 0;
+   bHasSavedMap_ = false;
+   FloorClock_ = 0;
+   UpStairs_ = FIntPoint(MAX_int32, MAX_int32);
+   DownStairs_ = FIntPoint(MAX_int32, MAX_int32);
+   bStairsArmed_ = false;
+   InstanceChunkSize_ = MAX_int32;
+   InstanceChunksX_ = 1;
+   MapVersion_ = 0;
+   WalkableVersion_ = 0;
+   ViewTile_ = FIntPoint(MAX_int32, MAX_int32);
+   ViewVersion_ = 0;
+   bFogActive_ = false;
+   FlowTile_ = FIntPoint(MAX_int32, MAX_int32);
+   FlowVersion_ = 0;
+   bEntityVisualsDirty_ = false;
+   EntityViewTile_ = FIntPoint(MAX_int32, MAX_int32);
 
    InstancedStaticMeshComponents.Empty();
 }
@@ -27,16 +135,55 @@ void ADungeonMapActor::BeginPlay()
    Build();
 }
 
+void ADungeonMapActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+   CancelGeneration();
+   ResetFloors();
+
+   Super::EndPlay(EndPlayReason);
+}
+
 // Called every frame
 void ADungeonMapActor::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+   if (bEndless)
+      UpdateStreaming(ChunksPerTick);
+   else if (bFogActive_)
+      UpdateFieldOfView();
+
+   if (bMultiFloor && !bEndless && !IsGenerating() && HasMap())
+      UpdateFloors();
+
+   if (bPlayerFlowFields && CanFindPath())
+      UpdatePlayerFlowFields();
+
+   if (EntityMeshes.Num() > 0 && !bFogActive_ && GetStreamingFocusTile() != EntityViewTile_)
+      bEntityVisualsDirty_ = true;
+
+   if (bEntityVisualsDirty_)
+      RefreshEntityVisuals();
 }
 
 #if WITH_EDITOR
 void ADungeonMapActor::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
+   // New generator inputs replace a saved map, everything else keeps it.
+   static const FName GeneratorProperties[] =
+   {
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, Seed), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, XSize),
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, YSize), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, MaxFeatures),
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, ChanceRoom), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, ChanceCorridor),
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, FeatureSampling), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, TileStorage),
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, Algorithm), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, GeneratedLayers),
+      GET_MEMBER_NAME_CHECKED(ADungeonMapActor, CaveIterations), GET_MEMBER_NAME_CHECKED(ADungeonMapActor, bRecordGraph)
+   };
+
+   for (const FName& Name : GeneratorProperties)
+      if (PropertyChangedEvent.GetPropertyName() == Name)
+         bHasSavedMap_ = false;
+
    Build();
    Super::PostEditChangeProperty(PropertyChangedEvent);
 }
@@ -45,16 +192,57 @@ void ADungeonMapActor::PostEditChangeProperty(FPropertyChangedEvent& PropertyCha
 
 void ADungeonMapActor::SetCell(int32 x, int32 y, ETileType celltype) 
 {
-   Data_[x + XSize * y] = celltype;
+   if (bEndless)
+   {
+      if (FStreamedChunk* Chunk = EditChunkCell(x, y, celltype))
+      {
+         InstanceChunk(*Chunk);
+         PublishInstanceCounts();
+      }
+
+      ++MapVersion_;
+      return;
+   }
+
+   Generator_.SetCell(x, y, celltype);
+   ++MapVersion_;
 }
 
 ETileType ADungeonMapActor::GetCell(int32 x, int32 y) const
 {
-   return Data_[x + XSize * y];
+   if (bEndless)
+   {
+      // Tiles of chunks that are not streamed in read as unused.
+      int32 Index;
+      const FStreamedChunk* Chunk = FindChunk(x, y, Index);
+      return Chunk ? Chunk->Cells[Index] : ETileType::TE_Unused;
+   }
+
+   return Generator_.GetCell(x, y);
 }
 
 void ADungeonMapActor::SetCells(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, ETileType cellType) 
 {
+   if (bEndless)
+   {
+      // Every touched chunk is instanced once, not once per tile.
+      TArray<FStreamedChunk*, TInlineAllocator<4>> Touched;
+
+      for (auto y = yStart; y != yEnd + 1; ++y)
+         for (auto x = xStart; x != xEnd + 1; ++x)
+            if (FStreamedChunk* Chunk = EditChunkCell(x, y, cellType))
+               Touched.AddUnique(Chunk);
+
+      for (FStreamedChunk* Chunk : Touched)
+         InstanceChunk(*Chunk);
+
+      if (Touched.Num())
+         PublishInstanceCounts();
+
+      ++MapVersion_;
+      return;
+   }
+
    for (auto y = yStart; y != yEnd + 1; ++y)
       for (auto x = xStart; x != xEnd + 1; ++x)
          SetCell(x, y, cellType);
@@ -62,16 +250,19 @@ void ADungeonMapActor::SetCells(int32 xStart, int32 yStart, int32 xEnd, int32 yE
 
 bool ADungeonMapActor::IsXInBounds(int32 x) const 
 {
-   return x >= 0 && x < XSize;
+   return bEndless || Generator_.IsXInBounds(x);
 }
 
 bool ADungeonMapActor::IsYInBounds(int32 y) const
 {
-   return y >= 0 && y < YSize;
+   return bEndless || Generator_.IsYInBounds(y);
 }
 
 bool ADungeonMapActor::IsAreaUnused(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd) 
 {
+   if (!bEndless)
+      return Generator_.IsAreaUnused(xStart, yStart, xEnd, yEnd);
+
    for (auto y = yStart; y != yEnd + 1; ++y)
       for (auto x = xStart; x != xEnd + 1; ++x)
          if (GetCell(x, y) != ETileType::TE_Unused)
@@ -89,341 +280,1907 @@ bool ADungeonMapActor::IsAdjacent(int32 x, int32 y, ETileType tile)
 
 void ADungeonMapActor::SetCellMeta(int32 x, int32 y, FTileMeta celltype)
 {
-   Meta_[x + XSize * y] = celltype;
+   // Streamed chunks carry no meta data.
+   if (!bEndless && Generator_.IsXInBounds(x) && Generator_.IsYInBounds(y))
+      Generator_.SetCellMeta(x, y, celltype);
 }
 
 FTileMeta ADungeonMapActor::GetCellMeta(int32 x, int32 y) const
 {
-   return Meta_[x + XSize * y];
+   if (bEndless || !Generator_.IsXInBounds(x) || !Generator_.IsYInBounds(y))
+      return FTileMeta();
+
+   return Generator_.GetCellMeta(x, y);
 }
 
-void ADungeonMapActor::Build() 
+void ADungeonMapActor::SetCellLayer(EDungeonLayer Layer, int32 x, int32 y, int32 Value)
 {
-   Generate();
+   if (!bEndless && Generator_.IsXInBounds(x) && Generator_.IsYInBounds(y))
+      Generator_.GetLayers().SetValue(Layer, x, y, Value);
+}
 
-   for (int32 i = 0; i < InstancedStaticMeshComponents.Num(); ++i) {
-      if (InstancedStaticMeshComponents[i]) {
-         InstancedStaticMeshComponents[i]->ClearInstances();
-      }
-   }
-   InstancedStaticMeshComponents.Empty();
+int32 ADungeonMapActor::GetCellLayer(EDungeonLayer Layer, int32 x, int32 y) const
+{
+   static const FDungeonLayers Defaults;
 
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_DirtWall));
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_DirtFloor));
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_Corridor));
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_Door));
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_UpStairs));
-   InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType::TE_DownStairs));
-
-   const int32 DirtWall_Index   = 0;
-   const int32 DirtFloor_Index  = 1;
-   const int32 Corridor_Index   = 2;
-   const int32 Door_Index       = 3;
-   const int32 UpStairs_Index   = 4;
-   const int32 DownStairs_Index = 5;
-
-   FTransform local = GetTransform();
-
-   auto scale = 10.0f;
-   FVector ScaleVector(scale, scale, scale);
-   FRotator Rotator(0.0f,0.0f,0.0f);
-     
-   for (auto y = 0; y != YSize; y++) {
-      for (auto x = 0; x != XSize; x++) {
-         switch (GetCell(x, y)) {
-            case ETileType::TE_DirtFloor: {
-               FVector size = MeshDefenitions.DirtFloor.StaticMesh->GetBoundingBox().GetSize();
-               FVector SpawnPosVector = local.GetLocation() + FVector(x * size.X * scale, y * size.Y * scale, 0.0f);
-               FTransform Transform(Rotator, SpawnPosVector, ScaleVector);
-               InstancedStaticMeshComponents[DirtFloor_Index]->AddInstance(Transform);
-               break;
-            }
-            case ETileType::TE_Corridor: {
-               FVector size = MeshDefenitions.Corridor.StaticMesh->GetBoundingBox().GetSize();
-               FVector SpawnPosVector = local.GetLocation() + FVector(x * size.X * scale, y * size.Y * scale, 0.0f);
-               FTransform Transform(Rotator, SpawnPosVector, ScaleVector);
-               InstancedStaticMeshComponents[Corridor_Index]->AddInstance(Transform);
-               break;
-            }
-            case ETileType::TE_DirtWall: {
-               FVector size = MeshDefenitions.DirtWall.StaticMesh->GetBoundingBox().GetSize();
-               FVector sizeF = MeshDefenitions.DirtFloor.StaticMesh->GetBoundingBox().GetSize();
-               FVector SpawnPosVector = local.GetLocation() + FVector(x * sizeF.X * scale, y * size.Y * scale, 0.0f);
-               FTransform Transform(Rotator, SpawnPosVector, ScaleVector);
-               InstancedStaticMeshComponents[DirtWall_Index]->AddInstance(Transform);
-               break;
-            }
-         }
-      }
-   }
+   if (bEndless || !Generator_.IsXInBounds(x) || !Generator_.IsYInBounds(y))
+      return Defaults.GetValue(Layer, 0, 0);
+
+   return Generator_.GetLayers().GetValue(Layer, x, y);
 }
 
-UInstancedStaticMeshComponent* ADungeonMapActor::BuildInstancedMesh(ETileType tile)
+int32 ADungeonMapActor::GetRegionCount() const
 {
-   UInstancedStaticMeshComponent* Proxy = NewObject<UInstancedStaticMeshComponent>(this);
-   Proxy->RegisterComponent();
-   Proxy->SetFlags(RF_Transactional);
+   return bEndless ? 0 : Generator_.GetGraph().NumRegions();
+}
 
-   switch (tile)
+FDungeonRegion ADungeonMapActor::GetRegion(int32 Region) const
+{
+   return Region >= 0 && Region < GetRegionCount() ? Generator_.GetGraph().GetRegions()[Region] : FDungeonRegion();
+}
+
+TArray<FDungeonDoor> ADungeonMapActor::GetRegionDoors(int32 Region) const
+{
+   TArray<FDungeonDoor> Doors;
+
+   if (Region >= 0 && Region < GetRegionCount())
    {
-   case ETileType::TE_Unused:
-      break;
-   case ETileType::TE_DirtWall:
-      if(MeshDefenitions.DirtWall.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.DirtWall.StaticMesh);
-      if(MeshDefenitions.DirtWall.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.DirtWall.Material, this));
-      break;
-   case ETileType::TE_DirtFloor:
-      if (MeshDefenitions.DirtFloor.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.DirtFloor.StaticMesh);
-      if (MeshDefenitions.DirtFloor.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.DirtFloor.Material, this));
-      break;
-   case ETileType::TE_Corridor:
-      if (MeshDefenitions.Corridor.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.Corridor.StaticMesh);
-      if (MeshDefenitions.Corridor.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.Corridor.Material, this));
-      break;
-   case ETileType::TE_Door:
-      if (MeshDefenitions.Door.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.Door.StaticMesh);
-      if (MeshDefenitions.Door.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.Door.Material, this));
-      break;
-   case ETileType::TE_UpStairs:
-      if (MeshDefenitions.UpStairs.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.UpStairs.StaticMesh);
-      if (MeshDefenitions.UpStairs.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.UpStairs.Material, this));
-      break;
-   case ETileType::TE_DownStairs:
-      if (MeshDefenitions.DownStairs.StaticMesh) Proxy->SetStaticMesh(MeshDefenitions.DownStairs.StaticMesh);
-      if (MeshDefenitions.DownStairs.Material) Proxy->SetMaterial(0, UMaterialInstanceDynamic::Create(MeshDefenitions.DownStairs.Material, this));
-      break;
+      const FDungeonGraph& Graph = Generator_.GetGraph();
+      Graph.ForEachDoor(Region, [&Graph, &Doors](int32 Door)
+      {
+         Doors.Add(Graph.GetDoors()[Door]);
+      });
    }
-   
-   return Proxy;
+
+   return Doors;
 }
 
-void ADungeonMapActor::Generate() 
+int32 ADungeonMapActor::FindRegion(int32 x, int32 y) const
 {
-   Data_.empty();
-   Data_ = std::vector<ETileType>(XSize * YSize, ETileType::TE_Unused);
-   
-   Meta_.empty();
-   Meta_.reserve(XSize * YSize);
-   
-   rnd_.seed(Seed);
-   MakeDungeon();
+   return bEndless ? -1 : Generator_.GetGraph().FindRegion(x, y);
+}
+
+int32 ADungeonMapActor::GetStairsRegion(bool bDown) const
+{
+   if (bEndless)
+      return -1;
+
+   return bDown ? Generator_.GetGraph().DownStairsRegion : Generator_.GetGraph().UpStairsRegion;
+}
+
+TArray<int32> ADungeonMapActor::GetRegionsWithinHops(int32 Region, int32 MaxHops, bool bRoomsOnly) const
+{
+   std::vector<int32> Regions;
+   if (!bEndless)
+      Generator_.GetGraph().GetRegionsWithinHops(Region, MaxHops, bRoomsOnly, Regions);
+
+   return TArray<int32>(Regions.data(), int32(Regions.size()));
+}
+
+int32 ADungeonMapActor::FindFarthestRoom(int32 Region) const
+{
+   return bEndless ? -1 : Generator_.GetGraph().FindFarthestRoom(Region);
 }
 
-int32 ADungeonMapActor::GetRandomInt(int32 min, int32 max)
+void ADungeonMapActor::SetSeed(int32 NewSeed)
 {
-   return std::uniform_int_distribution<int32>(min, max)(rnd_);
+   Seed = NewSeed;
+   bHasSavedMap_ = false;
+   Build();
+}
+
+void ADungeonMapActor::SetSize(int32 NewXSize, int32 NewYSize)
+{
+   XSize = NewXSize;
+   YSize = NewYSize;
+   bHasSavedMap_ = false;
+   Build();
+}
+
+void ADungeonMapActor::SetPlayerFlowFields(bool bEnable)
+{
+   bPlayerFlowFields = bEnable;
+   UpdateTickEnabled();
 }
 
-EDirection ADungeonMapActor::GetRandomDirection()
+void ADungeonMapActor::SetEntityMeshes(const TArray<FTileMesh>& Meshes)
 {
-   return EDirection(std::uniform_int_distribution<int>(0, 3)(rnd_));
+   EntityMeshes = Meshes;
+   bEntityVisualsDirty_ = true;
+   UpdateTickEnabled();
 }
 
-bool ADungeonMapActor::MakeCorridor(int32 x, int32 y, int32 maxLength, EDirection direction) 
+void ADungeonMapActor::Serialize(FArchive& Ar)
 {
-   auto length = GetRandomInt(2, maxLength);
+   Super::Serialize(Ar);
+
+   Ar.UsingCustomVersion(FDungeonMapActorVersion::GUID);
+   if (Ar.CustomVer(FDungeonMapActorVersion::GUID) < FDungeonMapActorVersion::SavedMap || Ar.IsObjectReferenceCollector())
+      return;
+
+   TArray<uint8> Encoded;
+
+   if (Ar.IsSaving() && bSaveMap && !bEndless && HasMap())
+   {
+      std::vector<uint8> Bytes;
+      FDungeonMapFile::Write(Generator_, Bytes);
+      Encoded.Append(Bytes.data(), int32(Bytes.size()));
+   }
+
+   Ar << Encoded;
+
+   if (Ar.IsLoading() && Encoded.Num())
+   {
+      FDungeonMapReader Reader;
+      ConfigureGenerator(Generator_);
+      bHasSavedMap_ = Reader.Open(Encoded.GetData(), Encoded.Num()) && Reader.Decode(Generator_);
 
-   auto xStart = x;
-   auto yStart = y;
+      if (!bHasSavedMap_)
+         UE_LOG(Logroguelike, Warning, TEXT("%s: saved map is corrupt, generating a new one"), *GetName());
+   }
+}
+
+bool ADungeonMapActor::SaveMap(const FString& Filename) const
+{
+   return !bEndless && HasMap() && FDungeonMapFile::Save(Generator_, Filename);
+}
 
-   auto xEnd = x;
-   auto yEnd = y;
+bool ADungeonMapActor::LoadMap(const FString& Filename)
+{
+   if (bEndless)
+      return false;
 
-   if (direction == EDirection::DE_North)
-      yStart = y - length;
-   else if (direction == EDirection::DE_East)
-      xEnd = x + length;
-   else if (direction == EDirection::DE_South)
-      yEnd = y + length;
-   else if (direction == EDirection::DE_West)
-      xStart = x - length;
+   const double StartTime = FPlatformTime::Seconds();
 
-   if (!IsXInBounds(xStart) || !IsXInBounds(xEnd) || !IsYInBounds(yStart) || !IsYInBounds(yEnd))
+   FDungeonMapFileView File;
+   if (!File.Open(Filename))
+   {
+      UE_LOG(Logroguelike, Warning, TEXT("%s: cannot open map file %s"), *GetName(), *Filename);
       return false;
+   }
+
+   CancelGeneration();
+   ResetFloors();
+   ConfigureGenerator(Generator_);
 
-   if (!IsAreaUnused(xStart, yStart, xEnd, yEnd))
+   if (!File.GetReader().Decode(Generator_))
+   {
+      UE_LOG(Logroguelike, Warning, TEXT("%s: map file %s is corrupt"), *GetName(), *Filename);
+      bHasSavedMap_ = false;
+      Build();
       return false;
+   }
 
-   SetCells(xStart, yStart, xEnd, yEnd, ETileType::TE_Corridor);
+   XSize = Generator_.XSize;
+   YSize = Generator_.YSize;
+   bHasSavedMap_ = true;
 
+   FinishBuild(FPlatformTime::Seconds() - StartTime);
    return true;
 }
 
-bool ADungeonMapActor::MakeRoom(int32 x, int32 y, int32 xMaxLength, int32 yMaxLength, EDirection direction) 
+bool ADungeonMapActor::IsGenerating() const
+{
+   return Job_.IsValid();
+}
+
+void ADungeonMapActor::Build() 
 {
-   // Minimum room size of 4x4 tiles (2x2 for walking on, the rest is walls)
-   auto xLength = GetRandomInt(4, xMaxLength);
-   auto yLength = GetRandomInt(4, yMaxLength);
+   SCOPE_CYCLE_COUNTER(STAT_DungeonBuild);
+   FDungeonCounters::Add(EDungeonCounter::Builds);
 
-   auto xStart = x;
-   auto yStart = y;
+   CancelGeneration();
 
-   auto xEnd = x;
-   auto yEnd = y;
+   // Other floors may have been generated from different inputs.
+   ResetFloors();
 
-   if (direction == EDirection::DE_North)
+   if (bEndless)
    {
-      yStart = y - yLength;
-      xStart = x - xLength / 2;
-      xEnd = x + (xLength + 1) / 2;
+      ClearInstancedMeshes();
+      UnloadAllChunks();
+      ChunkEdits_.clear();
+
+      Planner_.Seed = Seed;
+      Planner_.ChunkSize = ChunkSize;
+      Planner_.Margin = ChunkMargin;
+      Planner_.MaxFeatures = ChunkMaxFeatures;
+      Planner_.ChanceRoom = ChanceRoom;
+      Planner_.ChanceCorridor = ChanceCorridor;
+      Planner_.Sampling = FeatureSampling;
+      Planner_.Reset();
+
+      // Only the view radius is built up front, everything else streams in from Tick().
+      UpdateStreaming(MAX_int32);
+      UpdateTickEnabled();
+      OnDungeonReady.Broadcast();
+      return;
    }
-   else if (direction == EDirection::DE_East)
+
+   UnloadAllChunks();
+
+   if (bHasSavedMap_)
    {
-      yStart = y - yLength / 2;
-      yEnd = y + (yLength + 1) / 2;
-      xEnd = x + xLength;
+      FinishBuild(0.0);
+      return;
    }
-   else if (direction == EDirection::DE_South)
+
+   if (bAsyncGeneration)
    {
-      yEnd = y + yLength;
-      xStart = x - xLength / 2;
-      xEnd = x + (xLength + 1) / 2;
+      StartGeneration();
+      return;
    }
-   else if (direction == EDirection::DE_West)
+
+   const double StartTime = FPlatformTime::Seconds();
+
+   Generate();
+
+   FinishBuild(FPlatformTime::Seconds() - StartTime);
+}
+
+void ADungeonMapActor::StartGeneration()
+{
+   // Reuse the buffers of the last finished job, a cancelled one may still be in use by its worker.
+   TSharedPtr<FGenerationJob, ESPMode::ThreadSafe> Job = SpareJob_.IsValid() ? SpareJob_ : MakeShared<FGenerationJob, ESPMode::ThreadSafe>();
+   SpareJob_.Reset();
+
+   ConfigureGenerator(Job->Generator);
+   Job->bCancelled = false;
+   Job->Generator.CancelFlag = &Job->bCancelled;
+   Job_ = Job;
+
+   TWeakObjectPtr<ADungeonMapActor> WeakThis(this);
+
+   Async<void>(EAsyncExecution::ThreadPool, [WeakThis, Job]()
    {
-      yStart = y - yLength / 2;
-      yEnd = y + (yLength + 1) / 2;
-      xStart = x - xLength;
-   }
+      const double StartTime = FPlatformTime::Seconds();
+      Job->Generator.Generate();
+      Job->GenerateSeconds = FPlatformTime::Seconds() - StartTime;
 
-   if (!IsXInBounds(xStart) || !IsXInBounds(xEnd) || !IsYInBounds(yStart) || !IsYInBounds(yEnd))
-      return false;
+      AsyncTask(ENamedThreads::GameThread, [WeakThis, Job]()
+      {
+         // Results of cancelled or superseded jobs are dropped.
+         ADungeonMapActor* This = WeakThis.Get();
+         if (This && This->Job_ == Job && !Job->bCancelled)
+            This->FinishGeneration();
+      });
+   });
+}
 
-   if (!IsAreaUnused(xStart, yStart, xEnd, yEnd))
-      return false;
+void ADungeonMapActor::CancelGeneration()
+{
+   if (Job_.IsValid())
+   {
+      Job_->bCancelled = true;
+      Job_.Reset();
+   }
+}
 
-   //SetCellMeta()
-   
-   SetCells(xStart, yStart, xEnd, yEnd, ETileType::TE_DirtWall);
-   SetCells(xStart + 1, yStart + 1, xEnd - 1, yEnd - 1, ETileType::TE_DirtFloor);
+void ADungeonMapActor::FinishGeneration()
+{
+   TSharedPtr<FGenerationJob, ESPMode::ThreadSafe> Job = Job_;
+   Job_.Reset();
 
-   return true;
+   // Publish: the finished grid becomes the front buffer in one step, the old one is kept for the next run.
+   std::swap(Generator_, Job->Generator);
+   Generator_.CancelFlag = nullptr;
+   SpareJob_ = Job;
+
+   FinishBuild(Job->GenerateSeconds);
 }
 
-bool ADungeonMapActor::MakeFeature(int32 x, int32 y, int32 xmod, int32 ymod, EDirection direction)
+void ADungeonMapActor::FinishBuild(double GenerateSeconds)
 {
-   // Choose what to build
-   auto chance = GetRandomInt(0, 100);
+   SCOPE_CYCLE_COUNTER(STAT_DungeonBuildInstances);
+   FDungeonCounterTimer Timer(EDungeonCounter::InstancingMicroseconds);
+
+   const double StartTime = FPlatformTime::Seconds();
+
+   // A new map starts unexplored. The editor always shows the whole map.
+   bFogActive_ = bFogOfWar && GetWorld() && GetWorld()->IsGameWorld();
+   FieldOfView_.Reset(bFogActive_ ? Generator_.XSize : 0, bFogActive_ ? Generator_.YSize : 0);
+   Generator_.GetLayers().Explored.Fill(false);
+   ViewTile_ = FIntPoint(MAX_int32, MAX_int32);
+
+   // Components are pooled across builds, only tiles that changed since the last build are touched.
+   const FTileLayout Layout = MakeTileLayout();
+   EnsureInstancedMeshes(Layout);
+
+   const bool bIncremental = UpdateInstances(Layout);
+
+   if (!bIncremental)
+      RebuildInstances(Layout);
+
+   PrecomputedTransforms_.Reset();
+   PrecomputedWallBlockCounts_.Reset();
 
-   if (chance <= ChanceRoom)
+   if (bMultiFloor)
    {
-      if (MakeRoom(x + xmod, y + ymod, 8, 6, direction))
-      {
-         SetCell(x, y, ETileType::TE_Door);
+      if (!Generator_.FindTile(ETileType::TE_UpStairs, UpStairs_))
+         UpStairs_ = FIntPoint(MAX_int32, MAX_int32);
+      if (!Generator_.FindTile(ETileType::TE_DownStairs, DownStairs_))
+         DownStairs_ = FIntPoint(MAX_int32, MAX_int32);
+   }
 
-         // Remove wall next to the door.
-         SetCell(x + xmod, y + ymod, ETileType::TE_DirtFloor);
+   const double InstanceSeconds = FPlatformTime::Seconds() - StartTime;
+   LastBuildMilliseconds = float((GenerateSeconds + InstanceSeconds) * 1000.0);
 
-         return true;
-      }
+   UE_LOG(Logroguelike, Log, TEXT("%s: built %dx%d map in %.2f ms (generate %.2f ms, %s instances %.2f ms)"),
+      *GetName(), Generator_.XSize, Generator_.YSize, LastBuildMilliseconds, GenerateSeconds * 1000.0,
+      bIncremental ? TEXT("updated") : TEXT("rebuilt"), InstanceSeconds * 1000.0);
+
+   ++MapVersion_;
+
+   // Entities belong to the map they were spawned on, a new map or floor starts empty.
+   Entities_.Reset(Generator_.XSize);
+   EntityRng_ = Generator_.GetSubstream(EntitySubstream);
+   bEntityVisualsDirty_ = true;
+
+   UpdateTickEnabled();
+   PublishInstanceCounts();
+   OnDungeonReady.Broadcast();
+}
 
+bool ADungeonMapActor::ChangeFloor(int32 Delta)
+{
+   if (!bMultiFloor || bEndless || Delta == 0 || IsGenerating() || !HasMap())
       return false;
-   }
-   else
-   {
-      if (MakeCorridor(x + xmod, y + ymod, 6, direction))
-      {
-         SetCell(x, y, ETileType::TE_Door);
 
-         return true;
-      }
+   SCOPE_CYCLE_COUNTER(STAT_DungeonChangeFloor);
 
+   // Usually prefetched by now. Otherwise the player stays on this floor, UpdateFloors() retries next tick
+   // while the stairs are still armed.
+   TSharedPtr<FFloor, ESPMode::ThreadSafe> Floor = PrefetchFloor(CurrentFloor + Delta);
+   if (Floor->Task.IsValid() && !Floor->Task.IsReady())
+   {
+      FDungeonCounters::Add(EDungeonCounter::FloorChangeStalls);
       return false;
    }
+
+   std::swap(Generator_, Floor->Generator);
+   Generator_.CancelFlag = nullptr;
+   PrecomputedTransforms_ = MoveTemp(Floor->Transforms);
+   PrecomputedWallBlockCounts_ = MoveTemp(Floor->WallBlockCounts);
+   PrecomputedLayout_ = Floor->Layout;
+
+   // The entry keeps the floor being left, going back does not generate it again.
+   const FVector Origin = Floor->Origin;
+   Floor->Index = CurrentFloor;
+   Floor->Origin = GetActorLocation();
+   Floor->Transforms.Reset();
+   Floor->WallBlockCounts.Reset();
+   Floor->Task = TFuture<void>();
+   Floor->LastUsed = ++FloorClock_;
+
+   CurrentFloor += Delta;
+   bStairsArmed_ = false;
+   SetActorLocation(Origin);
+
+   FinishBuild(0.0);
+   return true;
 }
 
-bool ADungeonMapActor::MakeFeature()
+void ADungeonMapActor::UpdateFloors()
 {
-   auto tries = 0;
-   auto maxTries = 1000;
+   const FIntPoint Tile = WorldToTile(GetStreamingFocusWorld());
+   const ETileType Under = Generator_.IsXInBounds(Tile.X) && Generator_.IsYInBounds(Tile.Y) ? Generator_.GetCell(Tile.X, Tile.Y) : ETileType::TE_Unused;
 
-   for (; tries != maxTries; ++tries)
+   // Stairs only lead on after the player stepped off the ones they arrived on.
+   if (Under != ETileType::TE_UpStairs && Under != ETileType::TE_DownStairs)
    {
-      // Pick a random wall or corridor tile.
-      // Make sure it has no adjacent doors (looks weird to have doors next to each other).
-      // Find a direction from which it's reachable.
-      // Attempt to make a feature (room or corridor) starting at this point.
-
-      int x = GetRandomInt(1, XSize - 2);
-      int y = GetRandomInt(1, YSize - 2);
+      bStairsArmed_ = true;
+   }
+   else if (bStairsArmed_)
+   {
+      ChangeFloor(Under == ETileType::TE_DownStairs ? 1 : -1);
+      return;
+   }
 
-      if (GetCell(x, y) != ETileType::TE_DirtWall && GetCell(x, y) != ETileType::TE_Corridor)
-         continue;
+   auto IsNear = [this, &Tile](const FIntPoint& Stairs)
+   {
+      return Stairs.X != MAX_int32 && FMath::Max(FMath::Abs(Stairs.X - Tile.X), FMath::Abs(Stairs.Y - Tile.Y)) <= PrefetchDistance;
+   };
 
-      if (IsAdjacent(x, y, ETileType::TE_Door))
-         continue;
+   if (IsNear(DownStairs_))
+      PrefetchFloor(CurrentFloor + 1);
+   if (IsNear(UpStairs_))
+      PrefetchFloor(CurrentFloor - 1);
+}
 
-      if (GetCell(x, y + 1) == ETileType::TE_DirtFloor || GetCell(x, y + 1) == ETileType::TE_Corridor)
-      {
-         if (MakeFeature(x, y, 0, -1, EDirection::DE_North))
-            return true;
-      }
-      else if (GetCell(x - 1, y) == ETileType::TE_DirtFloor || GetCell(x - 1, y) == ETileType::TE_Corridor)
-      {
-         if (MakeFeature(x, y, 1, 0, EDirection::DE_East))
-            return true;
-      }
-      else if (GetCell(x, y - 1) == ETileType::TE_DirtFloor || GetCell(x, y - 1) == ETileType::TE_Corridor)
+TSharedPtr<ADungeonMapActor::FFloor, ESPMode::ThreadSafe> ADungeonMapActor::PrefetchFloor(int32 Index)
+{
+   for (const auto& Floor : Floors_)
+   {
+      if (Floor->Index == Index)
       {
-         if (MakeFeature(x, y, 0, 1, EDirection::DE_South))
-            return true;
+         Floor->LastUsed = ++FloorClock_;
+         return Floor;
       }
-      else if (GetCell(x + 1, y) == ETileType::TE_DirtFloor || GetCell(x + 1, y) == ETileType::TE_Corridor)
+   }
+
+   TSharedPtr<FFloor, ESPMode::ThreadSafe> Floor = MakeShared<FFloor, ESPMode::ThreadSafe>();
+   Floor->Index = Index;
+   Floor->LastUsed = ++FloorClock_;
+   ConfigureGenerator(Floor->Generator);
+   Floor->Generator.Stream = uint64(int64(Index));
+   Floor->Generator.CancelFlag = &Floor->bCancelled;
+   Floor->Layout = MakeTileLayout();
+   Floors_.Add(Floor);
+
+   // An adjacent floor is moved so that the stairs it is entered by lie under the stairs taken.
+   const auto Delta = Index - CurrentFloor;
+   const FIntPoint From = Delta == 1 ? DownStairs_ : Delta == -1 ? UpStairs_ : FIntPoint(MAX_int32, MAX_int32);
+   const FVector Origin = GetActorLocation();
+   const FVector TileSize = GetTileSize();
+
+   // Fog of war starts every floor unexplored, there is nothing to precompute.
+   const bool bTransforms = !(bFogOfWar && GetWorld() && GetWorld()->IsGameWorld());
+
+   int32 ChunkTiles, ChunksX, ChunksY;
+   GetInstanceChunkGrid(Floor->Generator.XSize, Floor->Generator.YSize, ChunkTiles, ChunksX, ChunksY);
+
+   Floor->Task = Async<void>(EAsyncExecution::ThreadPool, [Floor, Delta, From, Origin, TileSize, bTransforms, ChunkTiles, ChunksX, ChunksY]()
+   {
+      FDungeonGenerator& Generator = Floor->Generator;
+      Generator.Generate();
+
+      if (Floor->bCancelled)
+         return;
+
+      FIntPoint Arrival;
+      Floor->Origin = Origin;
+      if (From.X != MAX_int32 && Generator.FindTile(Delta > 0 ? ETileType::TE_UpStairs : ETileType::TE_DownStairs, Arrival))
+         Floor->Origin += FVector((From.X - Arrival.X) * TileSize.X, (From.Y - Arrival.Y) * TileSize.Y, 0.0f);
+
+      if (!bTransforms)
+         return;
+
+      Floor->Layout.Origin = Floor->Origin;
+      ComputeAllTransforms(Floor->Layout, ChunkTiles, ChunksX, ChunksY, Generator.XSize, Generator.YSize, [&Generator](int32 x, int32 y)
       {
-         if (MakeFeature(x, y, -1, 0, EDirection::DE_West))
-            return true;
+         return Generator.IsXInBounds(x) && Generator.IsYInBounds(y) ? Generator.GetCell(x, y) : ETileType::TE_Unused;
+      }, Floor->Transforms, Floor->WallBlockCounts);
+   });
+
+   // Least recently used floors are dropped, a generation still running stops at its next check.
+   while (Floors_.Num() > FMath::Max(FloorCacheSize, 1))
+   {
+      int32 Oldest = 0;
+      for (auto i = 1; i != Floors_.Num(); ++i)
+         if (Floors_[i]->LastUsed < Floors_[Oldest]->LastUsed)
+            Oldest = i;
+
+      Floors_[Oldest]->bCancelled = true;
+      Floors_.RemoveAtSwap(Oldest);
+   }
+
+   return Floor;
+}
+
+void ADungeonMapActor::ResetFloors()
+{
+   for (const auto& Floor : Floors_)
+      Floor->bCancelled = true;
+
+   Floors_.Reset();
+   PrecomputedTransforms_.Reset();
+   PrecomputedWallBlockCounts_.Reset();
+   bStairsArmed_ = false;
+}
+
+void ADungeonMapActor::ClearInstancedMeshes()
+{
+   for (int32 i = 0; i < InstancedStaticMeshComponents.Num(); ++i) {
+      if (InstancedStaticMeshComponents[i]) {
+         InstancedStaticMeshComponents[i]->ClearInstances();
       }
    }
 
-   return false;
+   BuiltCells_.clear();
+   InstanceOfCell_.clear();
+   for (auto& Cells : CellOfInstance_)
+      Cells.clear();
+   BuiltXSize_ = 0;
+
+   FirstWallBlock_.clear();
+   WallBlockInstances_.clear();
+   WallBlockOfInstance_.clear();
 }
 
-bool ADungeonMapActor::MakeStairs(ETileType tile) 
+void ADungeonMapActor::EnsureInstancedMeshes(const FTileLayout& Layout)
 {
-   auto tries = 0;
-   auto maxTries = 10000;
+   int32 ChunkTiles, ChunksX, ChunksY;
+   GetInstanceChunkGrid(Generator_.XSize, Generator_.YSize, ChunkTiles, ChunksX, ChunksY);
+   const auto Count = ChunksX * ChunksY * NumTileMeshes;
+
+   bool bReuse = ChunkTiles == InstanceChunkSize_ && ChunksX == InstanceChunksX_ &&
+      InstancedStaticMeshComponents.Num() == Count && !InstancedStaticMeshComponents.Contains(nullptr);
 
-   for (; tries != maxTries; ++tries)
+   for (auto i = 0; bReuse && i != InstancedStaticMeshComponents.Num(); ++i)
+      bReuse = InstancedStaticMeshComponents[i]->IsA<UHierarchicalInstancedStaticMeshComponent>() == bHierarchicalInstancing;
+
+   if (bReuse)
    {
-      int x = GetRandomInt(1, XSize - 2);
-      int y = GetRandomInt(1, YSize - 2);
+      for (auto i = 0; i != Count; ++i)
+         ApplyTileMesh(InstancedStaticMeshComponents[i], ETileType(i % NumTileMeshes + 1), Layout);
+      return;
+   }
 
-      if (!IsAdjacent(x, y, ETileType::TE_DirtFloor) && !IsAdjacent(x, y, ETileType::TE_Corridor))
-         continue;
+   ClearInstancedMeshes();
 
-      if (IsAdjacent(x, y, ETileType::TE_Door))
-         continue;
+   for (UInstancedStaticMeshComponent* Component : InstancedStaticMeshComponents)
+      if (Component)
+         Component->DestroyComponent();
 
-      SetCell(x, y, tile);
+   InstanceChunkSize_ = ChunkTiles;
+   InstanceChunksX_ = ChunksX;
 
-      return true;
-   }
+   // Chunks are row major, component order within a chunk follows ETileType. See MakeTileLayout() for the placement of each tile.
+   InstancedStaticMeshComponents.Reset(Count);
+   for (auto i = 0; i != Count; ++i)
+      InstancedStaticMeshComponents.Add(BuildInstancedMesh(ETileType(i % NumTileMeshes + 1), Layout));
+}
+
+int32 ADungeonMapActor::GetInstanceComponent(int32 cell, ETileType tile) const
+{
+   const auto x = cell % Generator_.XSize;
+   const auto y = cell / Generator_.XSize;
+
+   return ((y / InstanceChunkSize_) * InstanceChunksX_ + x / InstanceChunkSize_) * NumTileMeshes + int32(tile) - 1;
+}
+
+void ADungeonMapActor::GetInstanceChunkGrid(int32 MapXSize, int32 MapYSize, int32& OutChunkTiles, int32& OutChunksX, int32& OutChunksY) const
+{
+   OutChunkTiles = bHierarchicalInstancing ? InstanceChunkSize : MAX_int32;
+   OutChunksX = bHierarchicalInstancing ? FMath::Max(FMath::DivideAndRoundUp(MapXSize, OutChunkTiles), 1) : 1;
+   OutChunksY = bHierarchicalInstancing ? FMath::Max(FMath::DivideAndRoundUp(MapYSize, OutChunkTiles), 1) : 1;
+}
 
-   return false;
+void ADungeonMapActor::GetInstanceChunkRect(int32 Chunk, int32& OutX, int32& OutY, int32& OutWidth, int32& OutHeight) const
+{
+   OutX = (Chunk % InstanceChunksX_) * InstanceChunkSize_;
+   OutY = (Chunk / InstanceChunksX_) * InstanceChunkSize_;
+   OutWidth = FMath::Max(FMath::Min(InstanceChunkSize_, Generator_.XSize - OutX), 0);
+   OutHeight = FMath::Max(FMath::Min(InstanceChunkSize_, Generator_.YSize - OutY), 0);
 }
 
-bool ADungeonMapActor::MakeDungeon() 
+void ADungeonMapActor::RebuildInstances(const FTileLayout& Layout)
 {
-   // Make one room in the middle to start things off.
-   MakeRoom(XSize / 2, YSize / 2, 8, 6, GetRandomDirection());
+   const auto Count = Generator_.XSize * Generator_.YSize;
+
+   BuiltCells_.resize(Count);
+   InstanceOfCell_.assign(Count, -1);
+   CellOfInstance_.resize(InstancedStaticMeshComponents.Num());
+   for (auto& Cells : CellOfInstance_)
+      Cells.clear();
 
-   for (auto features = 1; features != MaxFeatures; ++features)
+   for (auto y = 0; y != Generator_.YSize; ++y)
+      for (auto x = 0; x != Generator_.XSize; ++x)
+         BuiltCells_[x + Generator_.XSize * y] = GetRenderedCell(x, y);
+
+   // A prefetched floor brings its instances along, unless fog of war hides some of them.
+   TArray<TArray<FTransform>> Transforms;
+   TArray<int32> WallBlockCounts;
+
+   if (PrecomputedTransforms_.Num() == InstancedStaticMeshComponents.Num() && IsSameLayout(Layout, PrecomputedLayout_) && !bFogActive_)
+   {
+      Transforms = MoveTemp(PrecomputedTransforms_);
+      WallBlockCounts = MoveTemp(PrecomputedWallBlockCounts_);
+   }
+   else
    {
-      if (!MakeFeature())
+      const auto NumChunks = InstancedStaticMeshComponents.Num() / NumTileMeshes;
+      ComputeAllTransforms(Layout, InstanceChunkSize_, InstanceChunksX_, NumChunks / InstanceChunksX_, Generator_.XSize, Generator_.YSize, [this](int32 x, int32 y)
       {
-        // std::cout << "Unable to place more features (placed " << features << ")." << std::endl;
-         break;
-      }
+         return Generator_.IsXInBounds(x) && Generator_.IsYInBounds(y) ? BuiltCells_[x + Generator_.XSize * y] : ETileType::TE_Unused;
+      }, Transforms, WallBlockCounts);
    }
 
-   if (!MakeStairs(ETileType::TE_UpStairs)) {
-      // std::cout << "Unable to place up stairs." << std::endl;
+   for (auto i = 0; i != InstancedStaticMeshComponents.Num(); ++i)
+      SetInstances(InstancedStaticMeshComponents[i], Transforms[i]);
+
+   if (Layout.bMergeWalls)
+      IndexMergedWalls(WallBlockCounts);
+
+   // Instances were emitted in row major order within each chunk, which is the map's row major order
+   // restricted to the chunk. Mirror that in the tile <-> instance mapping.
+   for (auto i = 0; i != Count; ++i)
+   {
+      const auto tile = BuiltCells_[i];
+      if (tile == ETileType::TE_Unused || !Layout.bPlaced[int32(tile) - 1])
+         continue;
+
+      auto& Cells = CellOfInstance_[GetInstanceComponent(i, tile)];
+      InstanceOfCell_[i] = int32(Cells.size());
+      Cells.push_back(i);
    }
-      
 
-   if (!MakeStairs(ETileType::TE_DownStairs)) {
-      // std::cout << "Unable to place down stairs." << std::endl;
+   BuiltLayout_ = Layout;
+   BuiltXSize_ = Generator_.XSize;
+}
+
+bool ADungeonMapActor::UpdateInstances(const FTileLayout& Layout)
+{
+   const auto Count = Generator_.XSize * Generator_.YSize;
+
+   if (BuiltXSize_ != Generator_.XSize || int32(BuiltCells_.size()) != Count || !IsSameLayout(Layout, BuiltLayout_) ||
+      int32(CellOfInstance_.size()) != InstancedStaticMeshComponents.Num())
+      return false;
+
+   // Components may have been touched behind our back, e.g. when the actor was duplicated for PIE.
+   // Merged walls are counted per block instead of per tile.
+   const auto NumChunks = InstancedStaticMeshComponents.Num() / NumTileMeshes;
+   if (Layout.bMergeWalls && int32(WallBlockOfInstance_.size()) != NumChunks)
+      return false;
+
+   for (auto i = 0; i != InstancedStaticMeshComponents.Num(); ++i)
+   {
+      const bool bMergedWall = Layout.bMergeWalls && i % NumTileMeshes == int32(ETileType::TE_DirtWall) - 1;
+      const auto Count = bMergedWall ? WallBlockOfInstance_[i / NumTileMeshes].size() : CellOfInstance_[i].size();
+
+      if (InstancedStaticMeshComponents[i]->GetInstanceCount() != int32(Count))
+         return false;
    }
 
+   std::vector<int32> Changed;
+   for (auto y = 0; y != Generator_.YSize; ++y)
+      for (auto x = 0; x != Generator_.XSize; ++x)
+         if (GetRenderedCell(x, y) != BuiltCells_[x + Generator_.XSize * y])
+            Changed.push_back(x + Generator_.XSize * y);
+
+   // A mostly different map is cheaper to submit in bulk.
+   if (Changed.size() * 2 > BuiltCells_.size())
+      return false;
+
+   ApplyInstanceChanges(Layout, Changed);
+
    return true;
-}
\ No newline at end of file
+}
+
+void ADungeonMapActor::ApplyInstanceChanges(const FTileLayout& Layout, const std::vector<int32>& Changed)
+{
+   auto IsPlaced = [&Layout](ETileType tile) { return tile != ETileType::TE_Unused && Layout.bPlaced[int32(tile) - 1]; };
+
+   auto GetTransform = [this, &Layout](int32 cell)
+   {
+      FTransform Transform;
+      GetTileTransform(Layout, BuiltCells_[cell], cell % Generator_.XSize, cell / Generator_.XSize, Transform);
+      return Transform;
+   };
+
+   // Free the instances of tiles that changed type. Only components that lost or gained an instance are touched.
+   std::vector<std::vector<int32>> Holes(InstancedStaticMeshComponents.Num());
+   std::vector<bool> IsTouched(InstancedStaticMeshComponents.Num(), false);
+   std::vector<int32> Touched;
+
+   auto Touch = [&IsTouched, &Touched](int32 c)
+   {
+      if (!IsTouched[c])
+      {
+         IsTouched[c] = true;
+         Touched.push_back(c);
+      }
+   };
+
+   for (const auto cell : Changed)
+   {
+      const auto old = BuiltCells_[cell];
+      if (IsPlaced(old))
+      {
+         const auto c = GetInstanceComponent(cell, old);
+         Holes[c].push_back(InstanceOfCell_[cell]);
+         Touch(c);
+      }
+
+      InstanceOfCell_[cell] = -1;
+      BuiltCells_[cell] = GetRenderedCell(cell % Generator_.XSize, cell / Generator_.XSize);
+   }
+
+   // New tiles take over freed instances first and only append when there are none left.
+   for (const auto cell : Changed)
+   {
+      const auto tile = BuiltCells_[cell];
+      if (!IsPlaced(tile))
+         continue;
+
+      const auto c = GetInstanceComponent(cell, tile);
+      UInstancedStaticMeshComponent* Component = InstancedStaticMeshComponents[c];
+      auto& Cells = CellOfInstance_[c];
+      Touch(c);
+
+      int32 Instance;
+      if (!Holes[c].empty())
+      {
+         Instance = Holes[c].back();
+         Holes[c].pop_back();
+         Component->UpdateInstanceTransform(Instance, GetTransform(cell));
+         Cells[Instance] = cell;
+      }
+      else
+      {
+         Instance = Component->AddInstance(GetTransform(cell));
+         Cells.push_back(cell);
+      }
+
+      InstanceOfCell_[cell] = Instance;
+   }
+
+   // Close the remaining holes with the last instance, RemoveInstance() on the last one does not shift any index.
+   for (const auto c : Touched)
+   {
+      UInstancedStaticMeshComponent* Component = InstancedStaticMeshComponents[c];
+      auto& Cells = CellOfInstance_[c];
+
+      std::sort(Holes[c].begin(), Holes[c].end(), [](int32 A, int32 B) { return A > B; });
+
+      for (const auto Hole : Holes[c])
+      {
+         const auto Last = int32(Cells.size()) - 1;
+
+         if (Hole != Last)
+         {
+            const auto cell = Cells[Last];
+            Component->UpdateInstanceTransform(Hole, GetTransform(cell));
+            Cells[Hole] = cell;
+            InstanceOfCell_[cell] = Hole;
+         }
+
+         Component->RemoveInstance(Last);
+         Cells.pop_back();
+      }
+
+      Component->MarkRenderStateDirty();
+   }
+
+   if (Layout.bMergeWalls)
+      UpdateMergedWalls(Layout, Changed);
+}
+
+void ADungeonMapActor::UpdateMergedWalls(const FTileLayout& Layout, const std::vector<int32>& Changed)
+{
+   // Whether a wall is drawn depends on its neighbours, so a change dirties the blocks around it too.
+   std::vector<bool> Dirty(WallBlockInstances_.size(), false);
+
+   for (const auto cell : Changed)
+   {
+      const auto x = cell % Generator_.XSize;
+      const auto y = cell / Generator_.XSize;
+
+      for (auto ny = FMath::Max(y - 1, 0); ny <= FMath::Min(y + 1, Generator_.YSize - 1); ++ny)
+         for (auto nx = FMath::Max(x - 1, 0); nx <= FMath::Min(x + 1, Generator_.XSize - 1); ++nx)
+            Dirty[GetWallBlock(nx, ny)] = true;
+   }
+
+   auto GetTile = [this](int32 x, int32 y)
+   {
+      return Generator_.IsXInBounds(x) && Generator_.IsYInBounds(y) ? BuiltCells_[x + Generator_.XSize * y] : ETileType::TE_Unused;
+   };
+
+   TArray<FTransform> Transforms;
+   const auto NumChunks = int32(FirstWallBlock_.size());
+
+   for (auto Chunk = 0; Chunk != NumChunks; ++Chunk)
+   {
+      int32 xStart, yStart, Width, Height;
+      GetInstanceChunkRect(Chunk, xStart, yStart, Width, Height);
+
+      bool bTouched = false;
+      auto Block = FirstWallBlock_[Chunk];
+
+      for (auto by = 0; by < Height; by += MergeBlockTiles)
+      {
+         for (auto bx = 0; bx < Width; bx += MergeBlockTiles, ++Block)
+         {
+            if (!Dirty[Block])
+               continue;
+
+            Transforms.Reset();
+            AppendMergedWalls(Layout, xStart + bx, yStart + by, FMath::Min(MergeBlockTiles, Width - bx), FMath::Min(MergeBlockTiles, Height - by),
+               GetTile, Transforms);
+
+            SetWallBlockInstances(Chunk, Block, Transforms);
+            bTouched = true;
+         }
+      }
+
+      if (bTouched)
+         InstancedStaticMeshComponents[Chunk * NumTileMeshes + int32(ETileType::TE_DirtWall) - 1]->MarkRenderStateDirty();
+   }
+}
+
+void ADungeonMapActor::SetWallBlockInstances(int32 Chunk, int32 Block, const TArray<FTransform>& Transforms)
+{
+   UInstancedStaticMeshComponent* Component = InstancedStaticMeshComponents[Chunk * NumTileMeshes + int32(ETileType::TE_DirtWall) - 1];
+   auto& Owners = WallBlockOfInstance_[Chunk];
+   auto& Instances = WallBlockInstances_[Block];
+
+   // The block keeps its instances as far as they go, then appends or frees the rest.
+   const auto Reused = FMath::Min(int32(Instances.size()), Transforms.Num());
+
+   for (auto i = 0; i != Reused; ++i)
+      Component->UpdateInstanceTransform(Instances[i], Transforms[i]);
+
+   for (auto i = Reused; i < Transforms.Num(); ++i)
+   {
+      Instances.push_back(Component->AddInstance(Transforms[i]));
+      Owners.push_back(Block);
+   }
+
+   std::vector<int32> Holes(Instances.begin() + Transforms.Num(), Instances.end());
+   Instances.resize(Transforms.Num());
+
+   // Close the holes with the last instance like ApplyInstanceChanges(), highest first.
+   std::sort(Holes.begin(), Holes.end(), [](int32 A, int32 B) { return A > B; });
+
+   for (const auto Hole : Holes)
+   {
+      const auto Last = int32(Owners.size()) - 1;
+
+      if (Hole != Last)
+      {
+         FTransform Moved;
+         Component->GetInstanceTransform(Last, Moved);
+         Component->UpdateInstanceTransform(Hole, Moved);
+
+         auto& Moving = WallBlockInstances_[Owners[Last]];
+         *std::find(Moving.begin(), Moving.end(), Last) = Hole;
+         Owners[Hole] = Owners[Last];
+      }
+
+      Component->RemoveInstance(Last);
+      Owners.pop_back();
+   }
+}
+
+void ADungeonMapActor::IndexMergedWalls(const TArray<int32>& BlockCounts)
+{
+   const auto NumChunks = InstancedStaticMeshComponents.Num() / NumTileMeshes;
+   FirstWallBlock_.resize(NumChunks);
+   WallBlockOfInstance_.resize(NumChunks);
+
+   auto NumBlocks = 0;
+   for (auto Chunk = 0; Chunk != NumChunks; ++Chunk)
+   {
+      int32 xStart, yStart, Width, Height;
+      GetInstanceChunkRect(Chunk, xStart, yStart, Width, Height);
+
+      FirstWallBlock_[Chunk] = NumBlocks;
+      NumBlocks += FMath::DivideAndRoundUp(Width, MergeBlockTiles) * FMath::DivideAndRoundUp(Height, MergeBlockTiles);
+   }
+
+   check(BlockCounts.Num() == NumBlocks);
+   WallBlockInstances_.resize(NumBlocks);
+
+   // Blocks were emitted one after the other into their chunk's component.
+   for (auto Chunk = 0; Chunk != NumChunks; ++Chunk)
+   {
+      auto& Owners = WallBlockOfInstance_[Chunk];
+      Owners.clear();
+
+      const auto End = Chunk + 1 < NumChunks ? FirstWallBlock_[Chunk + 1] : NumBlocks;
+      for (auto Block = FirstWallBlock_[Chunk]; Block != End; ++Block)
+      {
+         auto& Instances = WallBlockInstances_[Block];
+         Instances.clear();
+
+         for (auto i = 0; i != BlockCounts[Block]; ++i)
+         {
+            Instances.push_back(int32(Owners.size()));
+            Owners.push_back(Block);
+         }
+      }
+   }
+}
+
+int32 ADungeonMapActor::GetWallBlock(int32 x, int32 y) const
+{
+   const auto Chunk = GetInstanceComponent(x + Generator_.XSize * y, ETileType::TE_DirtWall) / NumTileMeshes;
+
+   int32 xStart, yStart, Width, Height;
+   GetInstanceChunkRect(Chunk, xStart, yStart, Width, Height);
+
+   return FirstWallBlock_[Chunk] + ((y - yStart) / MergeBlockTiles) * FMath::DivideAndRoundUp(Width, MergeBlockTiles) + (x - xStart) / MergeBlockTiles;
+}
+
+ETileType ADungeonMapActor::GetRenderedCell(int32 x, int32 y) const
+{
+   if (bFogActive_ && !FieldOfView_.GetExplored().Get(x, y))
+      return ETileType::TE_Unused;
+
+   return GetCell(x, y);
+}
+
+void ADungeonMapActor::UpdateFieldOfView()
+{
+   const FIntPoint Tile = WorldToTile(GetStreamingFocusWorld());
+   if (Tile == ViewTile_ && ViewVersion_ == MapVersion_)
+      return;
+
+   SCOPE_CYCLE_COUNTER(STAT_DungeonFieldOfView);
+
+   ViewTile_ = Tile;
+   ViewVersion_ = MapVersion_;
+
+   UpdateWalkable();
+
+   NewlyExplored_.clear();
+   FieldOfView_.Compute(Walkable_, Tile, ViewRadius, &NewlyExplored_);
+
+   // DL_Explored mirrors the fog so Blueprints and tools reading layers see the same tiles.
+   auto& Explored = Generator_.GetLayers().Explored;
+   for (const auto Cell : NewlyExplored_)
+      Explored.Set(Cell % Generator_.XSize, Cell / Generator_.XSize, true);
+
+   // Only tiles seen for the first time change what is rendered.
+   if (!NewlyExplored_.empty() && int32(BuiltCells_.size()) == Generator_.XSize * Generator_.YSize)
+      ApplyInstanceChanges(BuiltLayout_, NewlyExplored_);
+
+   bEntityVisualsDirty_ = true;
+}
+
+bool ADungeonMapActor::IsTileVisible(int32 x, int32 y) const
+{
+   return bFogActive_ && x >= 0 && y >= 0 && x < Generator_.XSize && y < Generator_.YSize && FieldOfView_.GetVisible().Get(x, y);
+}
+
+bool ADungeonMapActor::IsTileExplored(int32 x, int32 y) const
+{
+   return bFogActive_ && x >= 0 && y >= 0 && x < Generator_.XSize && y < Generator_.YSize && FieldOfView_.GetExplored().Get(x, y);
+}
+
+bool ADungeonMapActor::IsSameLayout(const FTileLayout& A, const FTileLayout& B)
+{
+   if (!A.Origin.Equals(B.Origin))
+      return false;
+
+   for (auto i = 0; i != NumTileMeshes; ++i)
+      if (A.bPlaced[i] != B.bPlaced[i] || !A.Step[i].Equals(B.Step[i]))
+         return false;
+
+   return A.bMergeWalls == B.bMergeWalls && A.WallMin.Equals(B.WallMin) && A.WallSize.Equals(B.WallSize);
+}
+
+FVector ADungeonMapActor::GetTileSize() const
+{
+   if (!MeshDefenitions.DirtFloor.StaticMesh)
+      return FVector(100.0f, 100.0f, 100.0f);
+
+   return MeshDefenitions.DirtFloor.StaticMesh->GetBoundingBox().GetSize() * TileScale;
+}
+
+ADungeonMapActor::FTileLayout ADungeonMapActor::MakeTileLayout() const
+{
+   FTileLayout Layout;
+   Layout.Origin = GetActorLocation();
+
+   for (auto i = 0; i != NumTileMeshes; ++i)
+   {
+      Layout.bPlaced[i] = false;
+      Layout.Step[i] = FVector2D::ZeroVector;
+   }
+
+   Layout.bMergeWalls = false;
+   Layout.WallMin = FVector2D::ZeroVector;
+   Layout.WallSize = FVector2D::ZeroVector;
+
+   const UStaticMesh* Floor = MeshDefenitions.DirtFloor.StaticMesh;
+   const UStaticMesh* Corridor = MeshDefenitions.Corridor.StaticMesh;
+   const UStaticMesh* Wall = MeshDefenitions.DirtWall.StaticMesh;
+
+   if (Floor)
+   {
+      Layout.bPlaced[int32(ETileType::TE_DirtFloor) - 1] = true;
+      Layout.Step[int32(ETileType::TE_DirtFloor) - 1] = FVector2D(Floor->GetBoundingBox().GetSize()) * TileScale;
+   }
+
+   if (Corridor)
+   {
+      Layout.bPlaced[int32(ETileType::TE_Corridor) - 1] = true;
+      Layout.Step[int32(ETileType::TE_Corridor) - 1] = FVector2D(Corridor->GetBoundingBox().GetSize()) * TileScale;
+   }
+
+   // Walls are spaced by the floor width so they line up with the floor tiles.
+   if (Wall && Floor)
+   {
+      Layout.bPlaced[int32(ETileType::TE_DirtWall) - 1] = true;
+      Layout.Step[int32(ETileType::TE_DirtWall) - 1] = FVector2D(Floor->GetBoundingBox().GetSize().X, Wall->GetBoundingBox().GetSize().Y) * TileScale;
+
+      const FBox WallBox = Wall->GetBoundingBox();
+      if (bMergeWalls && MergedWallMaterial && WallBox.GetSize().X > 0.0f && WallBox.GetSize().Y > 0.0f)
+      {
+         Layout.bPlaced[int32(ETileType::TE_DirtWall) - 1] = false;
+         Layout.bMergeWalls = true;
+         Layout.WallMin = FVector2D(WallBox.Min);
+         Layout.WallSize = FVector2D(WallBox.GetSize()) * TileScale;
+      }
+   }
+
+   return Layout;
+}
+
+bool ADungeonMapActor::GetTileTransform(const FTileLayout& Layout, ETileType tile, int32 x, int32 y, FTransform& OutTransform)
+{
+   if (tile == ETileType::TE_Unused || !Layout.bPlaced[int32(tile) - 1])
+      return false;
+
+   const FVector2D& Step = Layout.Step[int32(tile) - 1];
+   OutTransform = FTransform(FQuat::Identity, Layout.Origin + FVector(x * Step.X, y * Step.Y, 0.0f), FVector(TileScale));
+
+   return true;
+}
+
+void ADungeonMapActor::ComputeInstanceTransforms(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+   TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>* OutTransforms)
+{
+   const bool bSingleThread = Width * Height < 4096;
+
+   // Count pass, instances per row and tile type.
+   TArray<int32> Offsets;
+   Offsets.SetNumZeroed(Height * NumTileMeshes);
+
+   ParallelFor(Height, [&](int32 Row)
+   {
+      int32* Counts = &Offsets[Row * NumTileMeshes];
+
+      for (auto x = 0; x != Width; ++x)
+      {
+         const ETileType tile = GetTile(xOrigin + x, yOrigin + Row);
+         if (tile != ETileType::TE_Unused && Layout.bPlaced[int32(tile) - 1])
+            ++Counts[int32(tile) - 1];
+      }
+   }, bSingleThread);
+
+   // Prefix sums turn the counts into write offsets, so the fill pass needs no locks and keeps row order.
+   for (auto t = 0; t != NumTileMeshes; ++t)
+   {
+      int32 Total = 0;
+
+      for (auto Row = 0; Row != Height; ++Row)
+      {
+         int32& Offset = Offsets[Row * NumTileMeshes + t];
+         const int32 Count = Offset;
+         Offset = Total;
+         Total += Count;
+      }
+
+      OutTransforms[t].Reset(Total);
+      OutTransforms[t].SetNumUninitialized(Total);
+   }
+
+   ParallelFor(Height, [&](int32 Row)
+   {
+      int32 Cursor[NumTileMeshes];
+      FMemory::Memcpy(Cursor, &Offsets[Row * NumTileMeshes], sizeof(Cursor));
+
+      for (auto x = 0; x != Width; ++x)
+      {
+         const ETileType tile = GetTile(xOrigin + x, yOrigin + Row);
+         if (tile == ETileType::TE_Unused || !Layout.bPlaced[int32(tile) - 1])
+            continue;
+
+         const int32 t = int32(tile) - 1;
+         GetTileTransform(Layout, tile, xOrigin + x, yOrigin + Row, OutTransforms[t][Cursor[t]++]);
+      }
+   }, bSingleThread);
+}
+
+void ADungeonMapActor::ComputeAllTransforms(const FTileLayout& Layout, int32 ChunkTiles, int32 ChunksX, int32 ChunksY, int32 MapXSize, int32 MapYSize,
+   TFunctionRef<ETileType(int32, int32)> GetTile, TArray<TArray<FTransform>>& OutTransforms, TArray<int32>& OutWallBlockCounts)
+{
+   OutTransforms.SetNum(ChunksX * ChunksY * NumTileMeshes);
+   OutWallBlockCounts.Reset();
+
+   for (auto Chunk = 0; Chunk != ChunksX * ChunksY; ++Chunk)
+   {
+      const auto xStart = (Chunk % ChunksX) * ChunkTiles;
+      const auto yStart = (Chunk / ChunksX) * ChunkTiles;
+      const auto Width = FMath::Max(FMath::Min(ChunkTiles, MapXSize - xStart), 0);
+      const auto Height = FMath::Max(FMath::Min(ChunkTiles, MapYSize - yStart), 0);
+
+      TArray<FTransform>* ChunkTransforms = &OutTransforms[Chunk * NumTileMeshes];
+      ComputeInstanceTransforms(Layout, xStart, yStart, Width, Height, GetTile, ChunkTransforms);
+
+      if (Layout.bMergeWalls)
+         ComputeMergedWalls(Layout, xStart, yStart, Width, Height, GetTile, ChunkTransforms[int32(ETileType::TE_DirtWall) - 1], &OutWallBlockCounts);
+   }
+}
+
+int32 ADungeonMapActor::ComputeBuildTransforms(const FDungeonGenerator& Generator, int32 ChunkTiles, bool bMergeWalls)
+{
+   FTileLayout Layout;
+   Layout.Origin = FVector::ZeroVector;
+
+   for (auto i = 0; i != NumTileMeshes; ++i)
+   {
+      Layout.bPlaced[i] = true;
+      Layout.Step[i] = FVector2D(100.0f, 100.0f) * TileScale;
+   }
+
+   Layout.bMergeWalls = bMergeWalls;
+   Layout.bPlaced[int32(ETileType::TE_DirtWall) - 1] = !bMergeWalls;
+   Layout.WallMin = FVector2D(-50.0f, -50.0f);
+   Layout.WallSize = FVector2D(100.0f, 100.0f) * TileScale;
+
+   // One chunk covers at most the whole map, larger sizes would overflow the chunk count.
+   ChunkTiles = FMath::Clamp(ChunkTiles, 1, FMath::Max3(Generator.XSize, Generator.YSize, 1));
+   const auto ChunksX = FMath::Max(FMath::DivideAndRoundUp(Generator.XSize, ChunkTiles), 1);
+   const auto ChunksY = FMath::Max(FMath::DivideAndRoundUp(Generator.YSize, ChunkTiles), 1);
+
+   TArray<TArray<FTransform>> Transforms;
+   TArray<int32> WallBlockCounts;
+   ComputeAllTransforms(Layout, ChunkTiles, ChunksX, ChunksY, Generator.XSize, Generator.YSize, [&Generator](int32 x, int32 y)
+   {
+      return Generator.IsXInBounds(x) && Generator.IsYInBounds(y) ? Generator.GetCell(x, y) : ETileType::TE_Unused;
+   }, Transforms, WallBlockCounts);
+
+   int32 Count = 0;
+   for (const auto& ComponentTransforms : Transforms)
+      Count += ComponentTransforms.Num();
+   return Count;
+}
+
+void ADungeonMapActor::ComputeMergedWalls(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+   TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>& OutTransforms, TArray<int32>* OutBlockCounts)
+{
+   OutTransforms.Reset();
+
+   for (auto by = 0; by < Height; by += MergeBlockTiles)
+   {
+      for (auto bx = 0; bx < Width; bx += MergeBlockTiles)
+      {
+         const auto Before = OutTransforms.Num();
+         AppendMergedWalls(Layout, xOrigin + bx, yOrigin + by, FMath::Min(MergeBlockTiles, Width - bx), FMath::Min(MergeBlockTiles, Height - by),
+            GetTile, OutTransforms);
+
+         if (OutBlockCounts)
+            OutBlockCounts->Add(OutTransforms.Num() - Before);
+      }
+   }
+}
+
+void ADungeonMapActor::AppendMergedWalls(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+   TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>& OutTransforms)
+{
+   auto IsWalkable = [](ETileType tile) { return tile != ETileType::TE_Unused && tile != ETileType::TE_DirtWall; };
+
+   // Walls still to be covered, only those a walkable tile touches are seen from the top-down camera.
+   std::vector<uint8> Open(Width * Height, 0);
+
+   for (auto y = 0; y != Height; ++y)
+   {
+      for (auto x = 0; x != Width; ++x)
+      {
+         if (GetTile(xOrigin + x, yOrigin + y) != ETileType::TE_DirtWall)
+            continue;
+
+         bool bSeen = false;
+         for (auto dy = -1; dy <= 1 && !bSeen; ++dy)
+            for (auto dx = -1; dx <= 1 && !bSeen; ++dx)
+               bSeen = IsWalkable(GetTile(xOrigin + x + dx, yOrigin + y + dy));
+
+         Open[x + Width * y] = bSeen;
+      }
+   }
+
+   const FVector2D& Step = Layout.Step[int32(ETileType::TE_DirtWall) - 1];
+
+   auto IsOpenRun = [&Open, Width](int32 x, int32 y, int32 w)
+   {
+      for (auto i = 0; i != w; ++i)
+         if (!Open[x + i + Width * y])
+            return false;
+      return true;
+   };
+
+   for (auto y = 0; y != Height; ++y)
+   {
+      for (auto x = 0; x != Width; ++x)
+      {
+         if (!Open[x + Width * y])
+            continue;
+
+         auto w = 1;
+         while (x + w < Width && Open[x + w + Width * y])
+            ++w;
+
+         auto h = 1;
+         while (y + h < Height && IsOpenRun(x, y + h, w))
+            ++h;
+
+         for (auto j = 0; j != h; ++j)
+            FMemory::Memzero(&Open[x + Width * (y + j)], w);
+
+         // The stretched mesh spans from the near edge of the first tile to the far edge of the last one.
+         const FVector Scale(
+            TileScale * ((w - 1) * Step.X + Layout.WallSize.X) / Layout.WallSize.X,
+            TileScale * ((h - 1) * Step.Y + Layout.WallSize.Y) / Layout.WallSize.Y,
+            TileScale);
+
+         const FVector Location = Layout.Origin + FVector(
+            (xOrigin + x) * Step.X + Layout.WallMin.X * (TileScale - Scale.X),
+            (yOrigin + y) * Step.Y + Layout.WallMin.Y * (TileScale - Scale.Y),
+            0.0f);
+
+         OutTransforms.Add(FTransform(FQuat::Identity, Location, Scale));
+      }
+   }
+}
+
+void ADungeonMapActor::SetInstances(UInstancedStaticMeshComponent* Component, const TArray<FTransform>& Transforms)
+{
+   // AddInstance() releases the render data and updates navigation for every single instance.
+   Component->PerInstanceSMData.Reset(Transforms.Num());
+
+   for (const FTransform& Transform : Transforms)
+   {
+      FInstancedStaticMeshInstanceData& Instance = Component->PerInstanceSMData[Component->PerInstanceSMData.AddDefaulted()];
+      Instance.Transform = Transform.ToMatrixWithScale();
+   }
+
+   // Hierarchical components cull and pick LODs per cluster, their cluster tree has to follow the new instances.
+   if (UHierarchicalInstancedStaticMeshComponent* Hierarchical = Cast<UHierarchicalInstancedStaticMeshComponent>(Component))
+      Hierarchical->BuildTree();
+
+   Component->MarkRenderStateDirty();
+   Component->RecreatePhysicsState();
+   UNavigationSystem::UpdateComponentInNavOctree(*Component);
+}
+
+void ADungeonMapActor::UpdateStreaming(int32 Budget)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonUpdateStreaming);
+
+   auto Changed = 0;
+   ON_SCOPE_EXIT
+   {
+      if (Changed)
+         PublishInstanceCounts();
+   };
+
+   const auto Size = Planner_.ChunkSize;
+   const auto FocusTile = GetStreamingFocusTile();
+   const FIntPoint Center(FDungeonChunkPlanner::FloorDiv(FocusTile.X, Size), FDungeonChunkPlanner::FloorDiv(FocusTile.Y, Size));
+
+   // Evict chunks that left the view radius. One ring of slack keeps walking along a border from thrashing.
+   for (auto It = Chunks_.begin(); It != Chunks_.end();)
+   {
+      const auto& Coord = It->second.Coord;
+      if (FMath::Max(FMath::Abs(Coord.X - Center.X), FMath::Abs(Coord.Y - Center.Y)) > StreamRadius + 1)
+      {
+         UnloadChunk(It->second);
+         It = Chunks_.erase(It);
+         ++Changed;
+      }
+      else
+      {
+         ++It;
+      }
+   }
+
+   // Load missing chunks ring by ring, nearest first.
+   for (auto Ring = 0; Ring <= StreamRadius; ++Ring)
+   {
+      for (auto dy = -Ring; dy <= Ring; ++dy)
+      {
+         for (auto dx = -Ring; dx <= Ring; ++dx)
+         {
+            if (FMath::Max(FMath::Abs(dx), FMath::Abs(dy)) != Ring)
+               continue;
+
+            const FIntPoint Coord(Center.X + dx, Center.Y + dy);
+            if (Chunks_.count(FDungeonChunkPlanner::GetChunkKey(Coord)))
+               continue;
+
+            if (Budget-- <= 0)
+               return;
+
+            LoadChunk(Coord);
+            ++Changed;
+         }
+      }
+   }
+}
+
+void ADungeonMapActor::LoadChunk(const FIntPoint& Coord)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonLoadChunk);
+   FDungeonCounterTimer Timer(EDungeonCounter::InstancingMicroseconds);
+   FDungeonCounters::Add(EDungeonCounter::ChunksLoaded);
+
+   FStreamedChunk& Chunk = Chunks_[FDungeonChunkPlanner::GetChunkKey(Coord)];
+   Chunk.Coord = Coord;
+
+   Planner_.BuildChunk(Coord, Chunk.Cells);
+
+   auto Edits = ChunkEdits_.find(FDungeonChunkPlanner::GetChunkKey(Coord));
+   if (Edits != ChunkEdits_.end())
+      for (const auto& Edit : Edits->second)
+         Chunk.Cells[Edit.Key] = Edit.Value;
+
+   InstanceChunk(Chunk);
+}
+
+void ADungeonMapActor::InstanceChunk(FStreamedChunk& Chunk)
+{
+   const FTileLayout Layout = MakeTileLayout();
+
+   if (!Chunk.Components.Num())
+   {
+      for (auto tile = int32(ETileType::TE_DirtWall); tile <= int32(ETileType::TE_DownStairs); ++tile)
+      {
+         UInstancedStaticMeshComponent* Component = BuildInstancedMesh(ETileType(tile), Layout);
+         Chunk.Components.Add(Component);
+         StreamedComponents.Add(Component);
+      }
+   }
+
+   const auto Size = Planner_.ChunkSize;
+   const auto xOrigin = Chunk.Coord.X * Size;
+   const auto yOrigin = Chunk.Coord.Y * Size;
+
+   TArray<FTransform> Transforms[NumTileMeshes];
+   ComputeInstanceTransforms(Layout, xOrigin, yOrigin, Size, Size,
+      [&Chunk, xOrigin, yOrigin, Size](int32 x, int32 y) { return Chunk.Cells[(x - xOrigin) + Size * (y - yOrigin)]; }, Transforms);
+
+   // Neighbouring chunks may not be streamed in yet, tiles past the border count as walkable so no wall is dropped too early.
+   // The instances of a chunk therefore only depend on its own cells, an edit never re-instances the neighbours.
+   if (Layout.bMergeWalls)
+   {
+      ComputeMergedWalls(Layout, xOrigin, yOrigin, Size, Size, [&Chunk, xOrigin, yOrigin, Size](int32 x, int32 y)
+      {
+         const auto lx = x - xOrigin;
+         const auto ly = y - yOrigin;
+         return lx >= 0 && ly >= 0 && lx < Size && ly < Size ? Chunk.Cells[lx + Size * ly] : ETileType::TE_DirtFloor;
+      }, Transforms[int32(ETileType::TE_DirtWall) - 1]);
+   }
+
+   for (auto i = 0; i != NumTileMeshes; ++i)
+      SetInstances(Chunk.Components[i], Transforms[i]);
+}
+
+ADungeonMapActor::FStreamedChunk* ADungeonMapActor::EditChunkCell(int32 x, int32 y, ETileType tile)
+{
+   const auto Size = Planner_.ChunkSize;
+   const FIntPoint Coord(FDungeonChunkPlanner::FloorDiv(x, Size), FDungeonChunkPlanner::FloorDiv(y, Size));
+   const auto Key = FDungeonChunkPlanner::GetChunkKey(Coord);
+   const auto Index = (x - Coord.X * Size) + Size * (y - Coord.Y * Size);
+
+   // One edit per tile, the latest wins.
+   ChunkEdits_[Key].Add(Index, tile);
+
+   auto Chunk = Chunks_.find(Key);
+   if (Chunk == Chunks_.end())
+      return nullptr;
+
+   Chunk->second.Cells[Index] = tile;
+   return &Chunk->second;
+}
+
+void ADungeonMapActor::UnloadChunk(FStreamedChunk& Chunk)
+{
+   for (UInstancedStaticMeshComponent* Component : Chunk.Components)
+   {
+      StreamedComponents.Remove(Component);
+      if (Component)
+         Component->DestroyComponent();
+   }
+   Chunk.Components.Empty();
+}
+
+void ADungeonMapActor::PublishInstanceCounts() const
+{
+   int32 Counts[NumTileMeshes] = {};
+
+   for (auto i = 0; i != InstancedStaticMeshComponents.Num(); ++i)
+      if (InstancedStaticMeshComponents[i])
+         Counts[i % NumTileMeshes] += InstancedStaticMeshComponents[i]->GetInstanceCount();
+
+   for (const auto& Pair : Chunks_)
+      for (auto i = 0; i != FMath::Min(Pair.second.Components.Num(), NumTileMeshes); ++i)
+         if (Pair.second.Components[i])
+            Counts[i] += Pair.second.Components[i]->GetInstanceCount();
+
+   for (auto i = 0; i != NumTileMeshes; ++i)
+      FDungeonCounters::Set(EDungeonCounter(int32(EDungeonCounter::InstancesDirtWall) + i), Counts[i]);
+}
+
+void ADungeonMapActor::UnloadAllChunks()
+{
+   for (auto& Pair : Chunks_)
+      UnloadChunk(Pair.second);
+
+   Chunks_.clear();
+}
+
+ADungeonMapActor::FStreamedChunk* ADungeonMapActor::FindChunk(int32 x, int32 y, int32& OutIndex)
+{
+   return const_cast<FStreamedChunk*>(static_cast<const ADungeonMapActor*>(this)->FindChunk(x, y, OutIndex));
+}
+
+const ADungeonMapActor::FStreamedChunk* ADungeonMapActor::FindChunk(int32 x, int32 y, int32& OutIndex) const
+{
+   const auto Size = Planner_.ChunkSize;
+   const FIntPoint Coord(FDungeonChunkPlanner::FloorDiv(x, Size), FDungeonChunkPlanner::FloorDiv(y, Size));
+
+   auto Found = Chunks_.find(FDungeonChunkPlanner::GetChunkKey(Coord));
+   if (Found == Chunks_.end())
+      return nullptr;
+
+   OutIndex = (x - Coord.X * Size) + Size * (y - Coord.Y * Size);
+   return &Found->second;
+}
+
+FIntPoint ADungeonMapActor::GetStreamingFocusTile() const
+{
+   return WorldToTile(GetStreamingFocusWorld());
+}
+
+FVector ADungeonMapActor::GetStreamingFocusWorld() const
+{
+   if (const APawn* Pawn = UGameplayStatics::GetPlayerPawn(this, 0))
+      return Pawn->GetActorLocation();
+
+   return GetActorLocation();
+}
+
+FIntPoint ADungeonMapActor::WorldToTile(const FVector& Location) const
+{
+   const FVector Local = Location - GetActorLocation();
+   const FVector TileSize = GetTileSize();
+
+   return FIntPoint(FMath::FloorToInt(Local.X / TileSize.X), FMath::FloorToInt(Local.Y / TileSize.Y));
+}
+
+FVector ADungeonMapActor::TileToWorld(const FIntPoint& Tile) const
+{
+   const FVector TileSize = GetTileSize();
+
+   return GetActorLocation() + FVector((Tile.X + 0.5f) * TileSize.X, (Tile.Y + 0.5f) * TileSize.Y, 0.0f);
+}
+
+bool ADungeonMapActor::IntersectTiles(const FVector& RayOrigin, const FVector& RayDirection, float MaxDistance, FHitResult& OutHit) const
+{
+   const FVector Direction = RayDirection.GetSafeNormal();
+
+   // Only rays going down can hit the top faces, and a flat map has no tiles before its first build.
+   if (Direction.Z > -KINDA_SMALL_NUMBER || MaxDistance <= 0.0f || (!bEndless && MapVersion_ == 0))
+      return false;
+
+   auto HitTop = [&](const UStaticMesh* Mesh, float& OutDistance, FIntPoint& OutTile, ETileType& OutType)
+   {
+      const float Height = GetActorLocation().Z + (Mesh ? Mesh->GetBoundingBox().Max.Z * TileScale : 0.0f);
+      OutDistance = (Height - RayOrigin.Z) / Direction.Z;
+      if (OutDistance < 0.0f || OutDistance > MaxDistance)
+         return false;
+
+      // Tiles hidden by the fog of war have no instances for a trace to hit.
+      OutTile = WorldToTile(RayOrigin + Direction * OutDistance);
+      OutType = !IsXInBounds(OutTile.X) || !IsYInBounds(OutTile.Y) ? ETileType::TE_Unused :
+         bEndless ? GetCell(OutTile.X, OutTile.Y) : GetRenderedCell(OutTile.X, OutTile.Y);
+      return true;
+   };
+
+   float Distance;
+   FIntPoint Tile;
+   ETileType Type;
+
+   // Walls stand above the floor, so a wall top in the way is hit first.
+   const bool bWallHit = MeshDefenitions.DirtWall.StaticMesh && HitTop(MeshDefenitions.DirtWall.StaticMesh, Distance, Tile, Type) && Type == ETileType::TE_DirtWall;
+
+   // A ray reaching the floor plane inside a wall tile went through the side of the wall, leave that to the trace.
+   if (!bWallHit && !(HitTop(MeshDefenitions.DirtFloor.StaticMesh, Distance, Tile, Type) && Type != ETileType::TE_Unused && Type != ETileType::TE_DirtWall))
+      return false;
+
+   const FVector TraceEnd = RayOrigin + Direction * MaxDistance;
+   const FVector Point = RayOrigin + Direction * Distance;
+
+   OutHit = FHitResult(const_cast<ADungeonMapActor*>(this), FindTileComponent(Tile.X, Tile.Y, Type), Point, FVector::UpVector);
+   OutHit.bBlockingHit = true;
+   OutHit.Time = Distance / MaxDistance;
+   OutHit.Distance = Distance;
+   OutHit.TraceStart = RayOrigin;
+   OutHit.TraceEnd = TraceEnd;
+   return true;
+}
+
+UInstancedStaticMeshComponent* ADungeonMapActor::FindTileComponent(int32 x, int32 y, ETileType tile) const
+{
+   if (tile == ETileType::TE_Unused)
+      return nullptr;
+
+   if (bEndless)
+   {
+      int32 Index;
+      const FStreamedChunk* Chunk = FindChunk(x, y, Index);
+      return Chunk && Chunk->Components.IsValidIndex(int32(tile) - 1) ? Chunk->Components[int32(tile) - 1] : nullptr;
+   }
+
+   const auto Component = GetInstanceComponent(x + Generator_.XSize * y, tile);
+   return InstancedStaticMeshComponents.IsValidIndex(Component) ? InstancedStaticMeshComponents[Component] : nullptr;
+}
+
+void ADungeonMapActor::UpdateWalkable()
+{
+   if (WalkableVersion_ != MapVersion_)
+   {
+      Generator_.GetWalkable(Walkable_);
+      WalkableVersion_ = MapVersion_;
+   }
+}
+
+bool ADungeonMapActor::CanFindPath() const
+{
+   // Streamed chunks have no single grid to search.
+   return !bEndless && MapVersion_ != 0;
+}
+
+bool ADungeonMapActor::FindPath(const FVector& From, const FVector& To, TArray<FVector>& OutPoints)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonFindPath);
+
+   OutPoints.Reset();
+
+   if (!CanFindPath())
+      return false;
+
+   UpdateWalkable();
+
+   if (!Pathfinder_.FindPath(Walkable_, WorldToTile(From), WorldToTile(To), PathTiles_))
+      return false;
+
+   // The start tile is where the caller already is, the last point is the exact destination.
+   for (size_t i = 1; i < PathTiles_.size(); ++i)
+   {
+      FVector Point = i + 1 == PathTiles_.size() ? To : TileToWorld(PathTiles_[i]);
+      Point.Z = From.Z;
+      OutPoints.Add(Point);
+   }
+
+   return true;
+}
+
+FDungeonFlowField& ADungeonMapActor::FindOrAddFlowField(FName Layer)
+{
+   TUniquePtr<FDungeonFlowField>& Field = FlowFields_.FindOrAdd(Layer);
+   if (!Field)
+      Field = MakeUnique<FDungeonFlowField>();
+
+   return *Field;
+}
+
+const FDungeonFlowField* ADungeonMapActor::GetFlowField(FName Layer) const
+{
+   const TUniquePtr<FDungeonFlowField>* Field = FlowFields_.Find(Layer);
+   return Field && (*Field)->IsComputed() ? Field->Get() : nullptr;
+}
+
+bool ADungeonMapActor::UpdateFlowField(FName Layer, const TArray<FVector>& Goals, int32 Radius)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonFlowField);
+
+   if (!CanFindPath())
+      return false;
+
+   UpdateWalkable();
+
+   FlowGoals_.clear();
+   for (const FVector& Goal : Goals)
+      FlowGoals_.push_back(WorldToTile(Goal));
+
+   FindOrAddFlowField(Layer).Compute(Walkable_, FlowGoals_, Radius > 0 ? Radius : MAX_int32);
+   return true;
+}
+
+bool ADungeonMapActor::UpdateFleeField(FName Layer, FName From, float Coefficient)
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonFlowField);
+
+   const FDungeonFlowField* Toward = GetFlowField(From);
+   if (!CanFindPath() || !Toward || Layer == From)
+      return false;
+
+   UpdateWalkable();
+
+   FindOrAddFlowField(Layer).ComputeFlee(Walkable_, *Toward, Coefficient);
+   return true;
+}
+
+bool ADungeonMapActor::GetFlowStep(FName Layer, const FVector& From, FVector& OutTo) const
+{
+   const FDungeonFlowField* Field = GetFlowField(Layer);
+
+   FIntPoint Step;
+   if (!Field || !Field->GetNextStep(WorldToTile(From), Step))
+      return false;
+
+   OutTo = TileToWorld(Step);
+   OutTo.Z = From.Z;
+   return true;
+}
+
+int32 ADungeonMapActor::GetFlowDistance(FName Layer, const FVector& At) const
+{
+   const FDungeonFlowField* Field = GetFlowField(Layer);
+   if (!Field)
+      return FDungeonFlowField::Unreached;
+
+   const FIntPoint Tile = WorldToTile(At);
+   return Field->GetDistance(Tile.X, Tile.Y);
+}
+
+void ADungeonMapActor::UpdatePlayerFlowFields()
+{
+   const FIntPoint Tile = WorldToTile(GetStreamingFocusWorld());
+   if (Tile == FlowTile_ && FlowVersion_ == MapVersion_)
+      return;
+
+   SCOPE_CYCLE_COUNTER(STAT_DungeonFlowField);
+
+   FlowTile_ = Tile;
+   FlowVersion_ = MapVersion_;
+
+   UpdateWalkable();
+
+   FlowGoals_.assign(1, Tile);
+
+   FDungeonFlowField& Toward = FindOrAddFlowField(PlayerFlowField);
+   Toward.Compute(Walkable_, FlowGoals_, FlowFieldRadius > 0 ? FlowFieldRadius : MAX_int32);
+   FindOrAddFlowField(FleeFlowField).ComputeFlee(Walkable_, Toward, FleeCoefficient);
+}
+
+FDungeonEntityId ADungeonMapActor::SpawnEntity(EDungeonEntityKind Kind, int32 Type, const FIntPoint& Tile, int32 Speed)
+{
+   if (!CanFindPath() || !IsXInBounds(Tile.X) || !IsYInBounds(Tile.Y))
+      return FDungeonEntityId();
+
+   // The first entity of a map may be spawned long after the build enabled ticking or not.
+   if (Entities_.Num() == 0)
+      UpdateTickEnabled();
+
+   bEntityVisualsDirty_ = true;
+   return Entities_.Spawn(Kind, Type, Tile, Speed);
+}
+
+bool ADungeonMapActor::DespawnEntity(const FDungeonEntityId& Id)
+{
+   if (!Entities_.Despawn(Id))
+      return false;
+
+   bEntityVisualsDirty_ = true;
+   return true;
+}
+
+int32 ADungeonMapActor::SpawnRandomEntities(EDungeonEntityKind Kind, int32 Type, int32 Count, int32 Speed)
+{
+   if (!CanFindPath() || Count <= 0)
+      return 0;
+
+   UpdateWalkable();
+
+   // Rejection sampling, gives up on maps with hardly any free floor rather than scanning them.
+   auto Spawned = 0;
+   for (auto Attempt = 0; Spawned < Count && Attempt < Count * 16; ++Attempt)
+   {
+      const FIntPoint Tile(EntityRng_.Range(0, Generator_.XSize - 1), EntityRng_.Range(0, Generator_.YSize - 1));
+      if (!Walkable_.Get(Tile.X, Tile.Y) || Entities_.FindAt(Tile, Kind) >= 0 || Tile == GetStreamingFocusTile())
+         continue;
+
+      Entities_.Spawn(Kind, Type, Tile, Speed);
+      ++Spawned;
+   }
+
+   if (Spawned > 0)
+   {
+      bEntityVisualsDirty_ = true;
+      UpdateTickEnabled();
+   }
+
+   return Spawned;
+}
+
+bool ADungeonMapActor::MoveEntity(const FDungeonEntityId& Id, const FIntPoint& Tile)
+{
+   if (!Entities_.IsValid(Id) || !IsXInBounds(Tile.X) || !IsYInBounds(Tile.Y))
+      return false;
+
+   Entities_.Move(Id.Slot, Tile);
+   bEntityVisualsDirty_ = true;
+   return true;
+}
+
+bool ADungeonMapActor::GetEntityTile(const FDungeonEntityId& Id, FIntPoint& OutTile) const
+{
+   if (!Entities_.IsValid(Id))
+      return false;
+
+   OutTile = Entities_.GetTile(Id.Slot);
+   return true;
+}
+
+TArray<FDungeonEntityId> ADungeonMapActor::GetEntitiesAt(const FIntPoint& Tile) const
+{
+   TArray<FDungeonEntityId> Ids;
+
+   if (IsXInBounds(Tile.X) && IsYInBounds(Tile.Y))
+   {
+      Entities_.ForEachAt(Tile, [this, &Ids](int32 Slot)
+      {
+         Ids.Add(Entities_.GetId(Slot));
+         return true;
+      });
+   }
+
+   return Ids;
+}
+
+int32 ADungeonMapActor::GetEntityCount() const
+{
+   return Entities_.Num();
+}
+
+int32 ADungeonMapActor::AdvanceTurns(int32 Duration)
+{
+   if (!CanFindPath() || Duration <= 0)
+      return 0;
+
+   SCOPE_CYCLE_COUNTER(STAT_DungeonEntityTurns);
+
+   const FIntPoint Player = GetStreamingFocusTile();
+   const FDungeonFlowField* Chase = GetFlowField(PlayerFlowField);
+
+   const auto Turns = Entities_.RunTurns(Duration, [this, &Player, Chase](int32 Slot)
+   {
+      if (Entities_.GetKind(Slot) != EDungeonEntityKind::EK_Monster)
+         return 0;
+
+      // Monsters wait in place when the player is out of the field's reach or the way is blocked.
+      FIntPoint Step;
+      if (Chase && Chase->GetNextStep(Entities_.GetTile(Slot), Step) && Step != Player &&
+         Entities_.FindAt(Step, EDungeonEntityKind::EK_Monster) < 0)
+      {
+         Entities_.Move(Slot, Step);
+      }
+
+      return FDungeonEntities::TurnTime;
+   });
+
+   bEntityVisualsDirty_ |= Turns > 0;
+   return Turns;
+}
+
+void ADungeonMapActor::RefreshEntityVisuals()
+{
+   SCOPE_CYCLE_COUNTER(STAT_DungeonEntityVisuals);
+
+   bEntityVisualsDirty_ = false;
+   EntityViewTile_ = GetStreamingFocusTile();
+
+   while (EntityComponents_.Num() < EntityMeshes.Num())
+   {
+      // Entities only show where they are, they never block traces or change the navmesh.
+      UInstancedStaticMeshComponent* Component = NewObject<UInstancedStaticMeshComponent>(this);
+      Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+      Component->SetCanEverAffectNavigation(false);
+      Component->RegisterComponent();
+      EntityComponents_.Add(Component);
+   }
+
+   EntityTransforms_.SetNum(EntityComponents_.Num());
+   for (TArray<FTransform>& Transforms : EntityTransforms_)
+      Transforms.Reset();
+
+   // Only entities the player can see are instanced, the rest of the pool costs nothing to draw.
+   for (auto Slot = 0; Slot != Entities_.GetNumSlots(); ++Slot)
+   {
+      const auto Type = Entities_.IsAlive(Slot) ? Entities_.GetType(Slot) : -1;
+      if (Type < 0 || Type >= EntityMeshes.Num())
+         continue;
+
+      const FIntPoint Tile = Entities_.GetTile(Slot);
+      const bool bVisible = bFogActive_ ? FieldOfView_.GetVisible().Get(Tile.X, Tile.Y) :
+         FMath::Max(FMath::Abs(Tile.X - EntityViewTile_.X), FMath::Abs(Tile.Y - EntityViewTile_.Y)) <= ViewRadius;
+
+      if (bVisible)
+         EntityTransforms_[Type].Emplace(FQuat::Identity, TileToWorld(Tile), FVector(TileScale));
+   }
+
+   for (auto i = 0; i != EntityComponents_.Num(); ++i)
+   {
+      UInstancedStaticMeshComponent* Component = EntityComponents_[i];
+      const FTileMesh* Mesh = i < EntityMeshes.Num() ? &EntityMeshes[i] : nullptr;
+
+      if (Mesh && Mesh->StaticMesh && Component->GetStaticMesh() != Mesh->StaticMesh)
+         Component->SetStaticMesh(Mesh->StaticMesh);
+      if (Mesh && Mesh->Material && Component->GetMaterial(0) != Mesh->Material)
+         Component->SetMaterial(0, Mesh->Material);
+
+      // Skip the render state update for types that had no instances before and have none now.
+      if (Component->GetInstanceCount() > 0 || EntityTransforms_[i].Num() > 0)
+         SetInstances(Component, EntityTransforms_[i]);
+   }
+}
+
+void ADungeonMapActor::UpdateTickEnabled()
+{
+   // Nothing but these needs a per frame update, a plain static map does not tick at all.
+   SetActorTickEnabled(bEndless || bFogActive_ || bMultiFloor || bPlayerFlowFields || EntityMeshes.Num() > 0);
+}
+
+const FTileMesh* ADungeonMapActor::GetTileMesh(ETileType tile) const
+{
+   switch (tile)
+   {
+   case ETileType::TE_DirtWall:
+      return &MeshDefenitions.DirtWall;
+   case ETileType::TE_DirtFloor:
+      return &MeshDefenitions.DirtFloor;
+   case ETileType::TE_Corridor:
+      return &MeshDefenitions.Corridor;
+   case ETileType::TE_Door:
+      return &MeshDefenitions.Door;
+   case ETileType::TE_UpStairs:
+      return &MeshDefenitions.UpStairs;
+   case ETileType::TE_DownStairs:
+      return &MeshDefenitions.DownStairs;
+   default:
+      return nullptr;
+   }
+}
+
+void ADungeonMapActor::ApplyTileMesh(UInstancedStaticMeshComponent* Component, ETileType tile, const FTileLayout& Layout)
+{
+   const FTileMesh* TileMesh = GetTileMesh(tile);
+   if (!TileMesh)
+      return;
+
+   if (TileMesh->StaticMesh && Component->GetStaticMesh() != TileMesh->StaticMesh)
+      Component->SetStaticMesh(TileMesh->StaticMesh);
+
+   if (Component->InstanceStartCullDistance != InstanceStartCullDistance || Component->InstanceEndCullDistance != InstanceEndCullDistance)
+      Component->SetCullDistances(InstanceStartCullDistance, InstanceEndCullDistance);
+
+   // Merged walls are stretched and need the world space material.
+   UMaterial* Material = tile == ETileType::TE_DirtWall && Layout.bMergeWalls ? MergedWallMaterial : TileMesh->Material;
+
+   // Pooled components keep their material instance until the source material changes.
+   if (Material)
+   {
+      UMaterialInstanceDynamic* Current = Cast<UMaterialInstanceDynamic>(Component->GetMaterial(0));
+      if (!Current || Current->Parent != Material)
+         Component->SetMaterial(0, UMaterialInstanceDynamic::Create(Material, this));
+   }
+}
+
+UInstancedStaticMeshComponent* ADungeonMapActor::BuildInstancedMesh(ETileType tile, const FTileLayout& Layout)
+{
+   UInstancedStaticMeshComponent* Proxy = bHierarchicalInstancing ?
+      NewObject<UHierarchicalInstancedStaticMeshComponent>(this) : NewObject<UInstancedStaticMeshComponent>(this);
+   Proxy->RegisterComponent();
+   Proxy->SetFlags(RF_Transactional);
+
+   ApplyTileMesh(Proxy, tile, Layout);
+   
+   return Proxy;
+}
+
+void ADungeonMapActor::ConfigureGenerator(FDungeonGenerator& Generator) const
+{
+   Generator.Seed = Seed;
+   Generator.XSize = XSize;
+   Generator.YSize = YSize;
+   Generator.MaxFeatures = MaxFeatures;
+   Generator.ChanceRoom = ChanceRoom;
+   Generator.ChanceCorridor = ChanceCorridor;
+   Generator.Sampling = FeatureSampling;
+   Generator.Storage = TileStorage;
+   Generator.Algorithm = Algorithm;
+   Generator.CaveIterations = CaveIterations;
+   Generator.GeneratedLayers = GeneratedLayers;
+   Generator.bRecordGraph = bRecordGraph;
+   Generator.Stream = bMultiFloor ? uint64(int64(CurrentFloor)) : 0;
+}
+
+void ADungeonMapActor::Generate() 
+{
+   ConfigureGenerator(Generator_);
+   Generator_.Generate();
+}
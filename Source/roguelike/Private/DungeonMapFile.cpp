@@ -0,0 +1,363 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonMapFile.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/FileManager.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "Misc/FileHelper.h"
+#include "DungeonGenerator.h"
+
+namespace
+{
+   void WriteU16(std::vector<uint8>& Out, uint16 Value)
+   {
+      Out.push_back(uint8(Value));
+      Out.push_back(uint8(Value >> 8));
+   }
+
+   void WriteU32(std::vector<uint8>& Out, uint32 Value)
+   {
+      for (auto i = 0; i != 4; ++i)
+         Out.push_back(uint8(Value >> (8 * i)));
+   }
+
+   void PatchU32(std::vector<uint8>& Out, size_t Offset, uint32 Value)
+   {
+      for (auto i = 0; i != 4; ++i)
+         Out[Offset + i] = uint8(Value >> (8 * i));
+   }
+
+   uint32 ReadU32(const uint8* Data)
+   {
+      return uint32(Data[0]) | uint32(Data[1]) << 8 | uint32(Data[2]) << 16 | uint32(Data[3]) << 24;
+   }
+
+   uint16 ReadU16(const uint8* Data)
+   {
+      return uint16(Data[0] | Data[1] << 8);
+   }
+
+   uint8 PackCell(ETileType Tile, const FTileMeta& Meta)
+   {
+      return uint8(Tile) | uint8(uint8(Meta.dir) << 4);
+   }
+
+   bool IsValidCell(uint8 Cell)
+   {
+      return (Cell & 0xF) <= uint8(ETileType::TE_DownStairs) && (Cell >> 4) <= uint8(EDirection::DE_SouthEast);
+   }
+
+   /** Most tiles Bytes of runs can cover: as many five byte run lengths as fit, then one shorter run. */
+   uint64 GetMaxEncodedCells(uint32 Bytes)
+   {
+      const auto Rest = Bytes % 6;
+      return uint64(Bytes / 6) * MAX_uint32 + (Rest >= 2 ? (uint64(1) << (7 * (Rest - 1))) - 1 : 0);
+   }
+}
+
+void FDungeonMapFile::Write(const FDungeonGenerator& Generator, std::vector<uint8>& Out, int32 ChunkSize)
+{
+   check(ChunkSize > 0);
+
+   const auto XSize = Generator.XSize;
+   const auto YSize = Generator.YSize;
+   const auto ChunksX = FMath::DivideAndRoundUp(XSize, ChunkSize);
+   const auto ChunksY = FMath::DivideAndRoundUp(YSize, ChunkSize);
+   const auto NumChunks = ChunksX * ChunksY;
+
+   Out.clear();
+   WriteU32(Out, Magic);
+   WriteU16(Out, Version);
+   WriteU16(Out, 0);
+   WriteU32(Out, uint32(XSize));
+   WriteU32(Out, uint32(YSize));
+   WriteU32(Out, uint32(ChunkSize));
+   WriteU32(Out, uint32(NumChunks));
+   WriteU32(Out, 0);
+   WriteU32(Out, 0);
+
+   const auto ChunkEnds = Out.size();
+   Out.resize(Out.size() + 4 * NumChunks);
+   const auto Payload = Out.size();
+
+   auto Flush = [&Out](uint32 Count, uint8 Cell)
+   {
+      for (; Count >= 0x80; Count >>= 7)
+         Out.push_back(uint8(Count | 0x80));
+      Out.push_back(uint8(Count));
+      Out.push_back(Cell);
+   };
+
+   for (auto Chunk = 0; Chunk != NumChunks; ++Chunk)
+   {
+      const auto xStart = (Chunk % ChunksX) * ChunkSize;
+      const auto yStart = (Chunk / ChunksX) * ChunkSize;
+      const auto xEnd = FMath::Min(xStart + ChunkSize, XSize);
+      const auto yEnd = FMath::Min(yStart + ChunkSize, YSize);
+
+      uint32 Count = 0;
+      uint8 Current = 0;
+
+      for (auto y = yStart; y != yEnd; ++y)
+      {
+         for (auto x = xStart; x != xEnd; ++x)
+         {
+            const auto Cell = PackCell(Generator.GetCell(x, y), Generator.GetCellMeta(x, y));
+            if (Count && Cell != Current)
+            {
+               Flush(Count, Current);
+               Count = 0;
+            }
+
+            Current = Cell;
+            ++Count;
+         }
+      }
+
+      if (Count)
+         Flush(Count, Current);
+
+      PatchU32(Out, ChunkEnds + 4 * Chunk, uint32(Out.size() - Payload));
+   }
+
+   PatchU32(Out, 24, uint32(Out.size() - Payload));
+}
+
+bool FDungeonMapFile::Save(const FDungeonGenerator& Generator, const FString& Filename)
+{
+   std::vector<uint8> Bytes;
+   Write(Generator, Bytes);
+
+   TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileWriter(*Filename));
+   if (!Ar)
+      return false;
+
+   Ar->Serialize(Bytes.data(), int64(Bytes.size()));
+   return Ar->Close();
+}
+
+FDungeonMapReader::FDungeonMapReader()
+   : Data_(nullptr)
+   , Size_(0)
+   , XSize_(0)
+   , YSize_(0)
+   , ChunkSize_(0)
+   , ChunksX_(0)
+   , ChunksY_(0)
+   , ChunkEnds_(nullptr)
+   , Payload_(nullptr)
+   , PayloadSize_(0)
+{
+}
+
+bool FDungeonMapReader::Open(const uint8* Data, int64 Size)
+{
+   Data_ = nullptr;
+
+   if (!Data || Size < FDungeonMapFile::HeaderSize)
+      return false;
+
+   if (ReadU32(Data) != FDungeonMapFile::Magic || ReadU16(Data + 4) != FDungeonMapFile::Version)
+      return false;
+
+   XSize_ = int32(ReadU32(Data + 8));
+   YSize_ = int32(ReadU32(Data + 12));
+   ChunkSize_ = int32(ReadU32(Data + 16));
+   const auto NumChunks = int32(ReadU32(Data + 20));
+   PayloadSize_ = ReadU32(Data + 24);
+
+   // The generator indexes tiles with int32.
+   if (XSize_ < 0 || YSize_ < 0 || ChunkSize_ <= 0 || int64(XSize_) * YSize_ > MAX_int32)
+      return false;
+
+   ChunksX_ = int32((int64(XSize_) + ChunkSize_ - 1) / ChunkSize_);
+   ChunksY_ = int32((int64(YSize_) + ChunkSize_ - 1) / ChunkSize_);
+
+   if (int64(ChunksX_) * ChunksY_ != NumChunks || FDungeonMapFile::HeaderSize + 4 * int64(NumChunks) + PayloadSize_ > Size)
+      return false;
+
+   ChunkEnds_ = Data + FDungeonMapFile::HeaderSize;
+   Payload_ = ChunkEnds_ + 4 * NumChunks;
+
+   // Chunk ends have to be ordered and inside the payload, chunks are then safe to decode in any order.
+   // Sizes are checked against what each chunk's bytes could encode, so a forged header is rejected
+   // here rather than after the generator allocated a grid for it.
+   uint32 Previous = 0;
+   for (auto i = 0; i != NumChunks; ++i)
+   {
+      const auto End = ReadU32(ChunkEnds_ + 4 * i);
+      if (End < Previous || End > PayloadSize_)
+         return false;
+
+      const FIntRect Rect = GetChunkRect(i % ChunksX_, i / ChunksX_);
+      if (uint64(Rect.Area()) > GetMaxEncodedCells(End - Previous))
+         return false;
+
+      Previous = End;
+   }
+
+   Data_ = Data;
+   Size_ = Size;
+   return true;
+}
+
+FIntRect FDungeonMapReader::GetChunkRect(int32 ChunkX, int32 ChunkY) const
+{
+   const FIntPoint Min(ChunkX * ChunkSize_, ChunkY * ChunkSize_);
+   return FIntRect(Min, Min + FIntPoint(FMath::Min(ChunkSize_, XSize_ - Min.X), FMath::Min(ChunkSize_, YSize_ - Min.Y)));
+}
+
+template <typename FunctionType>
+bool FDungeonMapReader::ForEachRun(int32 ChunkX, int32 ChunkY, FunctionType Run) const
+{
+   if (!IsOpen() || ChunkX < 0 || ChunkY < 0 || ChunkX >= ChunksX_ || ChunkY >= ChunksY_)
+      return false;
+
+   const auto Chunk = ChunkX + ChunksX_ * ChunkY;
+   const uint8* Read = Payload_ + (Chunk ? ReadU32(ChunkEnds_ + 4 * (Chunk - 1)) : 0);
+   const uint8* End = Payload_ + ReadU32(ChunkEnds_ + 4 * Chunk);
+
+   const FIntRect Rect = GetChunkRect(ChunkX, ChunkY);
+   const auto Width = Rect.Max.X - Rect.Min.X;
+   const auto Height = Rect.Max.Y - Rect.Min.Y;
+   const auto Total = int64(Width) * Height;
+
+   int64 Decoded = 0;
+
+   while (Read != End)
+   {
+      uint32 Count = 0;
+      for (auto Shift = 0;; Shift += 7)
+      {
+         if (Read == End || Shift > 28)
+            return false;
+
+         const auto Byte = *Read++;
+         Count |= uint32(Byte & 0x7F) << Shift;
+         if (!(Byte & 0x80))
+            break;
+      }
+
+      if (Read == End || !IsValidCell(*Read) || Count == 0 || Decoded + Count > Total)
+         return false;
+
+      const auto Cell = *Read++;
+
+      // Runs continue across rows of the chunk.
+      while (Count)
+      {
+         const auto x = int32(Decoded % Width);
+         const auto y = int32(Decoded / Width);
+         const auto Span = FMath::Min(Count, uint32(Width - x));
+
+         Run(Rect.Min.X + x, Rect.Min.Y + y, int32(Span), Cell);
+
+         Decoded += Span;
+         Count -= Span;
+      }
+   }
+
+   return Decoded == Total;
+}
+
+bool FDungeonMapReader::DecodeChunk(int32 ChunkX, int32 ChunkY, std::vector<ETileType>& OutCells, std::vector<FTileMeta>* OutMeta) const
+{
+   const FIntRect Rect = GetChunkRect(ChunkX, ChunkY);
+   const auto Width = Rect.Max.X - Rect.Min.X;
+
+   OutCells.resize(size_t(FMath::Max(Width * (Rect.Max.Y - Rect.Min.Y), 0)));
+   if (OutMeta)
+      OutMeta->resize(OutCells.size());
+
+   return ForEachRun(ChunkX, ChunkY, [&](int32 x, int32 y, int32 Count, uint8 Cell)
+   {
+      const auto Index = (x - Rect.Min.X) + Width * (y - Rect.Min.Y);
+      std::fill(OutCells.begin() + Index, OutCells.begin() + Index + Count, ETileType(Cell & 0xF));
+
+      if (OutMeta)
+      {
+         FTileMeta Meta;
+         Meta.dir = EDirection(Cell >> 4);
+         std::fill(OutMeta->begin() + Index, OutMeta->begin() + Index + Count, Meta);
+      }
+   });
+}
+
+bool FDungeonMapReader::Decode(FDungeonGenerator& Generator) const
+{
+   if (!IsOpen())
+      return false;
+
+   // Maintaining the anchor frontier costs more than decoding the tiles, and a finished map is not extended.
+   Generator.XSize = XSize_;
+   Generator.YSize = YSize_;
+   Generator.Sampling = EFeatureSampling::FS_Rejection;
+   Generator.Reset();
+
+   for (auto ChunkY = 0; ChunkY != ChunksY_; ++ChunkY)
+   {
+      for (auto ChunkX = 0; ChunkX != ChunksX_; ++ChunkX)
+      {
+         const bool bValid = ForEachRun(ChunkX, ChunkY, [&Generator](int32 x, int32 y, int32 Count, uint8 Cell)
+         {
+            // A reset grid is all unused with default meta data, only the rest has to be written.
+            if (ETileType(Cell & 0xF) != ETileType::TE_Unused)
+               Generator.SetCells(x, y, x + Count - 1, y, ETileType(Cell & 0xF));
+
+            if (Cell >> 4)
+            {
+               FTileMeta Meta;
+               Meta.dir = EDirection(Cell >> 4);
+               for (auto i = 0; i != Count; ++i)
+                  Generator.SetCellMeta(x + i, y, Meta);
+            }
+         });
+
+         if (!bValid)
+            return false;
+      }
+   }
+
+   // Room and region ids are not stored, distances can be recomputed from the tiles.
+   if (Generator.GetLayers().EntranceDistance.IsAllocated())
+      Generator.ComputeEntranceDistance();
+
+   return true;
+}
+
+FDungeonMapFileView::FDungeonMapFileView()
+{
+}
+
+FDungeonMapFileView::~FDungeonMapFileView()
+{
+   Close();
+}
+
+bool FDungeonMapFileView::Open(const FString& Filename)
+{
+   Close();
+
+   // Mapping leaves paging in the tiles to the OS, nothing is copied before it is decoded.
+   Handle_.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+   if (Handle_)
+      Region_.Reset(Handle_->MapRegion());
+
+   if (Region_)
+      return Reader_.Open(Region_->GetMappedPtr(), Region_->GetMappedSize());
+
+   Handle_.Reset();
+
+   if (!FFileHelper::LoadFileToArray(Bytes_, *Filename))
+      return false;
+
+   return Reader_.Open(Bytes_.GetData(), Bytes_.Num());
+}
+
+void FDungeonMapFileView::Close()
+{
+   Reader_ = FDungeonMapReader();
+   Region_.Reset();
+   Handle_.Reset();
+   Bytes_.Empty();
+}
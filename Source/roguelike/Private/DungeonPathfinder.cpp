@@ -0,0 +1,264 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonPathfinder.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+   const float Sqrt2 = 1.41421356f;
+
+   float OctileDistance(int32 dx, int32 dy)
+   {
+      dx = FMath::Abs(dx);
+      dy = FMath::Abs(dy);
+      return float(FMath::Max(dx, dy) - FMath::Min(dx, dy)) + Sqrt2 * FMath::Min(dx, dy);
+   }
+
+   int32 Sign(int32 Value)
+   {
+      return (Value > 0) - (Value < 0);
+   }
+}
+
+FDungeonPathfinder::FDungeonPathfinder()
+   : Walkable_(nullptr)
+   , XSize_(0)
+   , YSize_(0)
+   , Search_(0)
+   , LastExpanded_(0)
+{
+}
+
+bool FDungeonPathfinder::FindPath(const FDungeonBitGrid& Walkable, const FIntPoint& Start, const FIntPoint& Goal, std::vector<FIntPoint>& OutPath)
+{
+   OutPath.clear();
+   LastExpanded_ = 0;
+
+   Walkable_ = &Walkable;
+   XSize_ = Walkable.GetXSize();
+   YSize_ = Walkable.GetYSize();
+   Goal_ = Goal;
+
+   if (!IsWalkable(Start.X, Start.Y) || !IsWalkable(Goal.X, Goal.Y))
+      return false;
+
+   const auto Count = size_t(XSize_) * size_t(YSize_);
+   if (Stamp_.size() != Count)
+   {
+      Stamp_.assign(Count, 0);
+      G_.resize(Count);
+      Parent_.resize(Count);
+      Closed_.resize(Count);
+      Search_ = 0;
+   }
+
+   if (++Search_ == 0)
+   {
+      std::fill(Stamp_.begin(), Stamp_.end(), 0);
+      Search_ = 1;
+   }
+
+   Open_.clear();
+
+   const auto StartCell = Start.X + XSize_ * Start.Y;
+   const auto GoalCell = Goal.X + XSize_ * Goal.Y;
+
+   Visit(StartCell, -1, 0.0f, Heuristic(Start.X, Start.Y));
+
+   while (!Open_.empty())
+   {
+      std::pop_heap(Open_.begin(), Open_.end());
+      const auto Cell = Open_.back().Cell;
+      Open_.pop_back();
+
+      // Entries are not updated in place, a cheaper path to a cell just pushes it again.
+      if (Closed_[Cell])
+         continue;
+
+      Closed_[Cell] = true;
+      ++LastExpanded_;
+
+      if (Cell == GoalCell)
+      {
+         for (auto Node = Cell; Node >= 0; Node = Parent_[Node])
+            OutPath.push_back(FIntPoint(Node % XSize_, Node / XSize_));
+         std::reverse(OutPath.begin(), OutPath.end());
+         return true;
+      }
+
+      const auto x = Cell % XSize_;
+      const auto y = Cell / XSize_;
+
+      // Pruned neighbours: only directions that can lead to a tile not reachable more cheaply
+      // through the parent. Diagonal moves need both adjacent straight tiles to be walkable.
+      int32 Neighbours[8][2];
+      auto NumNeighbours = 0;
+
+      auto Add = [&](int32 dx, int32 dy)
+      {
+         Neighbours[NumNeighbours][0] = dx;
+         Neighbours[NumNeighbours][1] = dy;
+         ++NumNeighbours;
+      };
+
+      if (Parent_[Cell] < 0)
+      {
+         for (auto dy = -1; dy <= 1; ++dy)
+            for (auto dx = -1; dx <= 1; ++dx)
+               if ((dx || dy) && (!dx || !dy || (IsWalkable(x + dx, y) && IsWalkable(x, y + dy))))
+                  Add(dx, dy);
+      }
+      else
+      {
+         const auto dx = Sign(x - Parent_[Cell] % XSize_);
+         const auto dy = Sign(y - Parent_[Cell] / XSize_);
+
+         if (dx && dy)
+         {
+            const bool bVertical = IsWalkable(x, y + dy);
+            const bool bHorizontal = IsWalkable(x + dx, y);
+
+            if (bVertical)
+               Add(0, dy);
+            if (bHorizontal)
+               Add(dx, 0);
+            if (bVertical && bHorizontal)
+               Add(dx, dy);
+         }
+         else if (dx)
+         {
+            const bool bNext = IsWalkable(x + dx, y);
+            const bool bUp = IsWalkable(x, y + 1);
+            const bool bDown = IsWalkable(x, y - 1);
+
+            if (bNext)
+            {
+               Add(dx, 0);
+               if (bUp)
+                  Add(dx, 1);
+               if (bDown)
+                  Add(dx, -1);
+            }
+            if (bUp)
+               Add(0, 1);
+            if (bDown)
+               Add(0, -1);
+         }
+         else
+         {
+            const bool bNext = IsWalkable(x, y + dy);
+            const bool bRight = IsWalkable(x + 1, y);
+            const bool bLeft = IsWalkable(x - 1, y);
+
+            if (bNext)
+            {
+               Add(0, dy);
+               if (bRight)
+                  Add(1, dy);
+               if (bLeft)
+                  Add(-1, dy);
+            }
+            if (bRight)
+               Add(1, 0);
+            if (bLeft)
+               Add(-1, 0);
+         }
+      }
+
+      for (auto i = 0; i != NumNeighbours; ++i)
+      {
+         int32 jx;
+         int32 jy;
+
+         if (!Jump(x + Neighbours[i][0], y + Neighbours[i][1], Neighbours[i][0], Neighbours[i][1], jx, jy))
+            continue;
+
+         Visit(jx + XSize_ * jy, Cell, G_[Cell] + OctileDistance(jx - x, jy - y), Heuristic(jx, jy));
+      }
+   }
+
+   return false;
+}
+
+bool FDungeonPathfinder::Jump(int32 x, int32 y, int32 dx, int32 dy, int32& OutX, int32& OutY) const
+{
+   if (!dx || !dy)
+      return JumpStraight(x, y, dx, dy, OutX, OutY);
+
+   for (;;)
+   {
+      if (!IsWalkable(x, y))
+         return false;
+
+      int32 jx;
+      int32 jy;
+
+      // A diagonal run stops where one of its straight branches finds a jump point.
+      if ((x == Goal_.X && y == Goal_.Y) || JumpStraight(x + dx, y, dx, 0, jx, jy) || JumpStraight(x, y + dy, 0, dy, jx, jy))
+      {
+         OutX = x;
+         OutY = y;
+         return true;
+      }
+
+      if (!IsWalkable(x + dx, y) || !IsWalkable(x, y + dy))
+         return false;
+
+      x += dx;
+      y += dy;
+   }
+}
+
+bool FDungeonPathfinder::JumpStraight(int32 x, int32 y, int32 dx, int32 dy, int32& OutX, int32& OutY) const
+{
+   for (;; x += dx, y += dy)
+   {
+      if (!IsWalkable(x, y))
+         return false;
+
+      bool bJumpPoint = x == Goal_.X && y == Goal_.Y;
+
+      // Forced neighbour: a side tile that opens up right after a blocked one.
+      if (dx)
+         bJumpPoint = bJumpPoint ||
+            (IsWalkable(x, y - 1) && !IsWalkable(x - dx, y - 1)) ||
+            (IsWalkable(x, y + 1) && !IsWalkable(x - dx, y + 1));
+      else
+         bJumpPoint = bJumpPoint ||
+            (IsWalkable(x - 1, y) && !IsWalkable(x - 1, y - dy)) ||
+            (IsWalkable(x + 1, y) && !IsWalkable(x + 1, y - dy));
+
+      if (bJumpPoint)
+      {
+         OutX = x;
+         OutY = y;
+         return true;
+      }
+   }
+}
+
+void FDungeonPathfinder::Visit(int32 Cell, int32 ParentCell, float G, float H)
+{
+   if (Stamp_[Cell] != Search_)
+   {
+      Stamp_[Cell] = Search_;
+      G_[Cell] = std::numeric_limits<float>::max();
+      Closed_[Cell] = false;
+   }
+
+   if (Closed_[Cell] || G >= G_[Cell])
+      return;
+
+   G_[Cell] = G;
+   Parent_[Cell] = ParentCell;
+
+   Open_.push_back({ G + H, Cell });
+   std::push_heap(Open_.begin(), Open_.end());
+}
+
+float FDungeonPathfinder::Heuristic(int32 x, int32 y) const
+{
+   return OctileDistance(Goal_.X - x, Goal_.Y - y);
+}
@@ -0,0 +1,189 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonProfiling.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "DungeonGenerator.h"
+#include "roguelike.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Generations"), STAT_DungeonGenerations, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Features placed"), STAT_DungeonFeaturesPlaced, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Feature tries"), STAT_DungeonFeatureTries, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected: wrong tile"), STAT_DungeonRejectedTile, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected: adjacent door"), STAT_DungeonRejectedDoor, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected: out of bounds"), STAT_DungeonRejectedBounds, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected: area used"), STAT_DungeonRejectedArea, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stair tries"), STAT_DungeonStairTries, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Stairs missing"), STAT_DungeonStairsMissing, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Builds"), STAT_DungeonBuilds, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Chunks loaded"), STAT_DungeonChunksLoaded, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: wall"), STAT_DungeonInstancesDirtWall, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: floor"), STAT_DungeonInstancesDirtFloor, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: corridor"), STAT_DungeonInstancesCorridor, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: door"), STAT_DungeonInstancesDoor, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: up stairs"), STAT_DungeonInstancesUpStairs, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances: down stairs"), STAT_DungeonInstancesDownStairs, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Player ticks"), STAT_DungeonPlayerTicks, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Character ticks"), STAT_DungeonCharacterTicks, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Cursor traces"), STAT_DungeonCursorTraces, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Cursor tile hits"), STAT_DungeonCursorTileHits, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Floor change stalls"), STAT_DungeonFloorChangeStalls, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Generate (us)"), STAT_DungeonGenerateMicroseconds, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Instancing (us)"), STAT_DungeonInstancingMicroseconds, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Player tick (us)"), STAT_DungeonPlayerTickMicroseconds, STATGROUP_Dungeon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Character tick (us)"), STAT_DungeonCharacterTickMicroseconds, STATGROUP_Dungeon);
+
+std::atomic<int64> FDungeonCounters::Values[int32(EDungeonCounter::Num)];
+
+namespace
+{
+#if STATS
+   FName GetStatName(EDungeonCounter Counter)
+   {
+      switch (Counter)
+      {
+      case EDungeonCounter::Generations: return GET_STATFNAME(STAT_DungeonGenerations);
+      case EDungeonCounter::FeaturesPlaced: return GET_STATFNAME(STAT_DungeonFeaturesPlaced);
+      case EDungeonCounter::FeatureTries: return GET_STATFNAME(STAT_DungeonFeatureTries);
+      case EDungeonCounter::RejectedTile: return GET_STATFNAME(STAT_DungeonRejectedTile);
+      case EDungeonCounter::RejectedDoor: return GET_STATFNAME(STAT_DungeonRejectedDoor);
+      case EDungeonCounter::RejectedBounds: return GET_STATFNAME(STAT_DungeonRejectedBounds);
+      case EDungeonCounter::RejectedArea: return GET_STATFNAME(STAT_DungeonRejectedArea);
+      case EDungeonCounter::StairTries: return GET_STATFNAME(STAT_DungeonStairTries);
+      case EDungeonCounter::StairsMissing: return GET_STATFNAME(STAT_DungeonStairsMissing);
+      case EDungeonCounter::Builds: return GET_STATFNAME(STAT_DungeonBuilds);
+      case EDungeonCounter::ChunksLoaded: return GET_STATFNAME(STAT_DungeonChunksLoaded);
+      case EDungeonCounter::InstancesDirtWall: return GET_STATFNAME(STAT_DungeonInstancesDirtWall);
+      case EDungeonCounter::InstancesDirtFloor: return GET_STATFNAME(STAT_DungeonInstancesDirtFloor);
+      case EDungeonCounter::InstancesCorridor: return GET_STATFNAME(STAT_DungeonInstancesCorridor);
+      case EDungeonCounter::InstancesDoor: return GET_STATFNAME(STAT_DungeonInstancesDoor);
+      case EDungeonCounter::InstancesUpStairs: return GET_STATFNAME(STAT_DungeonInstancesUpStairs);
+      case EDungeonCounter::InstancesDownStairs: return GET_STATFNAME(STAT_DungeonInstancesDownStairs);
+      case EDungeonCounter::PlayerTicks: return GET_STATFNAME(STAT_DungeonPlayerTicks);
+      case EDungeonCounter::CharacterTicks: return GET_STATFNAME(STAT_DungeonCharacterTicks);
+      case EDungeonCounter::CursorTraces: return GET_STATFNAME(STAT_DungeonCursorTraces);
+      case EDungeonCounter::CursorTileHits: return GET_STATFNAME(STAT_DungeonCursorTileHits);
+      case EDungeonCounter::FloorChangeStalls: return GET_STATFNAME(STAT_DungeonFloorChangeStalls);
+      case EDungeonCounter::GenerateMicroseconds: return GET_STATFNAME(STAT_DungeonGenerateMicroseconds);
+      case EDungeonCounter::InstancingMicroseconds: return GET_STATFNAME(STAT_DungeonInstancingMicroseconds);
+      case EDungeonCounter::PlayerTickMicroseconds: return GET_STATFNAME(STAT_DungeonPlayerTickMicroseconds);
+      case EDungeonCounter::CharacterTickMicroseconds: return GET_STATFNAME(STAT_DungeonCharacterTickMicroseconds);
+      default: return NAME_None;
+      }
+   }
+#endif
+
+   void DumpCounters(const TArray<FString>& Args)
+   {
+      const FString FileName = Args.Num() ? Args[0] : FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonCounters.csv"));
+
+      if (FDungeonCounters::DumpCsv(FileName))
+         UE_LOG(Logroguelike, Display, TEXT("Dungeon counters written to %s"), *FileName);
+      else
+         UE_LOG(Logroguelike, Error, TEXT("Failed to write dungeon counters to %s"), *FileName);
+   }
+
+   FAutoConsoleCommand DumpCountersCommand(
+      TEXT("Dungeon.DumpCounters"),
+      TEXT("Writes the dungeon counters as CSV to the given file, default Saved/DungeonCounters.csv"),
+      FConsoleCommandWithArgsDelegate::CreateStatic(&DumpCounters));
+
+   FAutoConsoleCommand ResetCountersCommand(
+      TEXT("Dungeon.ResetCounters"),
+      TEXT("Clears the dungeon counters"),
+      FConsoleCommandDelegate::CreateStatic(&FDungeonCounters::Reset));
+}
+
+void FDungeonCounters::Add(EDungeonCounter Counter, int64 Value)
+{
+   Values[int32(Counter)].fetch_add(Value, std::memory_order_relaxed);
+
+#if STATS
+   const FName StatName = GetStatName(Counter);
+   if (StatName != NAME_None)
+      INC_DWORD_STAT_BY_FName(StatName, Value);
+#endif
+}
+
+void FDungeonCounters::Set(EDungeonCounter Counter, int64 Value)
+{
+   Values[int32(Counter)].store(Value, std::memory_order_relaxed);
+
+#if STATS
+   const FName StatName = GetStatName(Counter);
+   if (StatName != NAME_None)
+      SET_DWORD_STAT_FName(StatName, Value);
+#endif
+}
+
+int64 FDungeonCounters::Get(EDungeonCounter Counter)
+{
+   return Values[int32(Counter)].load(std::memory_order_relaxed);
+}
+
+void FDungeonCounters::AddGeneratorStats(const FDungeonStats& Stats, bool bStairs)
+{
+   Add(EDungeonCounter::Generations);
+   Add(EDungeonCounter::FeaturesPlaced, Stats.FeaturesPlaced);
+   Add(EDungeonCounter::FeatureTries, Stats.FeaturesPlaced + Stats.FailedTries);
+   Add(EDungeonCounter::RejectedTile, Stats.RejectedTile);
+   Add(EDungeonCounter::RejectedDoor, Stats.RejectedDoor);
+   Add(EDungeonCounter::RejectedBounds, Stats.RejectedBounds);
+   Add(EDungeonCounter::RejectedArea, Stats.RejectedArea);
+   if (bStairs)
+   {
+      Add(EDungeonCounter::StairTries, Stats.StairTries);
+      Add(EDungeonCounter::StairsMissing, (Stats.bUpStairs ? 0 : 1) + (Stats.bDownStairs ? 0 : 1));
+   }
+}
+
+void FDungeonCounters::Reset()
+{
+   for (auto& Value : Values)
+      Value.store(0, std::memory_order_relaxed);
+}
+
+bool FDungeonCounters::DumpCsv(const FString& FileName)
+{
+   FString Csv = TEXT("Counter,Value\n");
+
+   for (auto i = 0; i != int32(EDungeonCounter::Num); ++i)
+      Csv += FString::Printf(TEXT("%s,%lld\n"), GetName(EDungeonCounter(i)), Get(EDungeonCounter(i)));
+
+   return FFileHelper::SaveStringToFile(Csv, *FileName);
+}
+
+const TCHAR* FDungeonCounters::GetName(EDungeonCounter Counter)
+{
+   switch (Counter)
+   {
+   case EDungeonCounter::Generations: return TEXT("Generations");
+   case EDungeonCounter::FeaturesPlaced: return TEXT("FeaturesPlaced");
+   case EDungeonCounter::FeatureTries: return TEXT("FeatureTries");
+   case EDungeonCounter::RejectedTile: return TEXT("RejectedTile");
+   case EDungeonCounter::RejectedDoor: return TEXT("RejectedDoor");
+   case EDungeonCounter::RejectedBounds: return TEXT("RejectedBounds");
+   case EDungeonCounter::RejectedArea: return TEXT("RejectedArea");
+   case EDungeonCounter::StairTries: return TEXT("StairTries");
+   case EDungeonCounter::StairsMissing: return TEXT("StairsMissing");
+   case EDungeonCounter::Builds: return TEXT("Builds");
+   case EDungeonCounter::ChunksLoaded: return TEXT("ChunksLoaded");
+   case EDungeonCounter::InstancesDirtWall: return TEXT("InstancesDirtWall");
+   case EDungeonCounter::InstancesDirtFloor: return TEXT("InstancesDirtFloor");
+   case EDungeonCounter::InstancesCorridor: return TEXT("InstancesCorridor");
+   case EDungeonCounter::InstancesDoor: return TEXT("InstancesDoor");
+   case EDungeonCounter::InstancesUpStairs: return TEXT("InstancesUpStairs");
+   case EDungeonCounter::InstancesDownStairs: return TEXT("InstancesDownStairs");
+   case EDungeonCounter::PlayerTicks: return TEXT("PlayerTicks");
+   case EDungeonCounter::CharacterTicks: return TEXT("CharacterTicks");
+   case EDungeonCounter::CursorTraces: return TEXT("CursorTraces");
+   case EDungeonCounter::CursorTileHits: return TEXT("CursorTileHits");
+   case EDungeonCounter::FloorChangeStalls: return TEXT("FloorChangeStalls");
+   case EDungeonCounter::GenerateMicroseconds: return TEXT("GenerateMicroseconds");
+   case EDungeonCounter::InstancingMicroseconds: return TEXT("InstancingMicroseconds");
+   case EDungeonCounter::PlayerTickMicroseconds: return TEXT("PlayerTickMicroseconds");
+   case EDungeonCounter::CharacterTickMicroseconds: return TEXT("CharacterTickMicroseconds");
+   default: return TEXT("Unknown");
+   }
+}
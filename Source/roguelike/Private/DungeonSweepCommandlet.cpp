@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DungeonSweepCommandlet.h"
+#include "Async/ParallelFor.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "DungeonGenerator.h"
+#include "roguelike.h"
+
+namespace
+{
+   const TCHAR* GetTileChar(ETileType tile)
+   {
+      switch (tile)
+      {
+      case ETileType::TE_DirtWall:
+         return TEXT("#");
+      case ETileType::TE_DirtFloor:
+         return TEXT(".");
+      case ETileType::TE_Corridor:
+         return TEXT(",");
+      case ETileType::TE_Door:
+         return TEXT("+");
+      case ETileType::TE_UpStairs:
+         return TEXT("<");
+      case ETileType::TE_DownStairs:
+         return TEXT(">");
+      default:
+         return TEXT(" ");
+      }
+   }
+
+   FColor GetTileColor(ETileType tile)
+   {
+      switch (tile)
+      {
+      case ETileType::TE_DirtWall:
+         return FColor(96, 72, 48);
+      case ETileType::TE_DirtFloor:
+         return FColor(200, 180, 140);
+      case ETileType::TE_Corridor:
+         return FColor(150, 150, 150);
+      case ETileType::TE_Door:
+         return FColor(200, 40, 40);
+      case ETileType::TE_UpStairs:
+         return FColor(40, 200, 40);
+      case ETileType::TE_DownStairs:
+         return FColor(40, 40, 200);
+      default:
+         return FColor::Black;
+      }
+   }
+
+   /** Algorithm named like in DungeonBenchmark, false for an unknown name. */
+   bool ParseAlgorithm(const FString& Name, EDungeonAlgorithm& OutAlgorithm)
+   {
+      if (Name == TEXT("Accretion"))
+         OutAlgorithm = EDungeonAlgorithm::DA_Accretion;
+      else if (Name == TEXT("BSP"))
+         OutAlgorithm = EDungeonAlgorithm::DA_BSP;
+      else if (Name == TEXT("Drunkard"))
+         OutAlgorithm = EDungeonAlgorithm::DA_Drunkard;
+      else if (Name == TEXT("Cellular"))
+         OutAlgorithm = EDungeonAlgorithm::DA_Cellular;
+      else
+         return false;
+
+      return true;
+   }
+
+   void SaveAscii(const FDungeonGenerator& Generator, const FString& FileName)
+   {
+      FString Text;
+      Text.Reserve((Generator.XSize + 1) * Generator.YSize);
+
+      for (auto y = 0; y != Generator.YSize; ++y)
+      {
+         for (auto x = 0; x != Generator.XSize; ++x)
+            Text += GetTileChar(Generator.GetCell(x, y));
+         Text += TEXT("\n");
+      }
+
+      FFileHelper::SaveStringToFile(Text, *FileName);
+   }
+
+   void SavePng(IImageWrapperModule& ImageWrapperModule, const FDungeonGenerator& Generator, const FString& FileName)
+   {
+      TArray<FColor> Pixels;
+      Pixels.SetNumUninitialized(Generator.XSize * Generator.YSize);
+
+      for (auto y = 0; y != Generator.YSize; ++y)
+         for (auto x = 0; x != Generator.XSize; ++x)
+            Pixels[x + Generator.XSize * y] = GetTileColor(Generator.GetCell(x, y));
+
+      TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
+      if (ImageWrapper.IsValid() && ImageWrapper->SetRaw(Pixels.GetData(), Pixels.Num() * sizeof(FColor), Generator.XSize, Generator.YSize, ERGBFormat::BGRA, 8))
+         FFileHelper::SaveArrayToFile(ImageWrapper->GetCompressed(), *FileName);
+   }
+}
+
+UDungeonSweepCommandlet::UDungeonSweepCommandlet()
+{
+   IsClient = false;
+   IsServer = false;
+   IsEditor = false;
+   LogToConsole = true;
+}
+
+int32 UDungeonSweepCommandlet::Main(const FString& Params)
+{
+   int32 SeedStart = 0;
+   int32 SeedCount = 1000;
+   FParse::Value(*Params, TEXT("SeedStart="), SeedStart);
+   FParse::Value(*Params, TEXT("SeedCount="), SeedCount);
+
+   // Template for the per worker generators
+   FDungeonGenerator Settings;
+   FParse::Value(*Params, TEXT("XSize="), Settings.XSize);
+   FParse::Value(*Params, TEXT("YSize="), Settings.YSize);
+   FParse::Value(*Params, TEXT("MaxFeatures="), Settings.MaxFeatures);
+   FParse::Value(*Params, TEXT("ChanceRoom="), Settings.ChanceRoom);
+   FParse::Value(*Params, TEXT("ChanceCorridor="), Settings.ChanceCorridor);
+   FParse::Value(*Params, TEXT("CaveIterations="), Settings.CaveIterations);
+   if (FParse::Param(*Params, TEXT("Rejection")))
+      Settings.Sampling = EFeatureSampling::FS_Rejection;
+   if (FParse::Param(*Params, TEXT("BitPlanes")))
+      Settings.Storage = ETileStorage::TS_BitPlanes;
+
+   const bool bAscii = FParse::Param(*Params, TEXT("Ascii"));
+   const bool bPng = FParse::Param(*Params, TEXT("Png"));
+
+   FString OutDir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DungeonSweep"));
+   FParse::Value(*Params, TEXT("Out="), OutDir);
+
+   FString AlgorithmName;
+   if (FParse::Value(*Params, TEXT("Algorithm="), AlgorithmName) && !ParseAlgorithm(AlgorithmName, Settings.Algorithm))
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonSweep: unknown algorithm %s, expected Accretion, BSP, Drunkard or Cellular"), *AlgorithmName);
+      return 1;
+   }
+
+   if (SeedCount <= 0 || Settings.XSize < 3 || Settings.YSize < 3)
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonSweep: nothing to do for SeedCount=%d XSize=%d YSize=%d"), SeedCount, Settings.XSize, Settings.YSize);
+      return 1;
+   }
+
+   // Modules have to be loaded on the game thread.
+   IImageWrapperModule* ImageWrapperModule = bPng ? &FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper")) : nullptr;
+
+   TArray<FDungeonStats> Results;
+   Results.SetNum(SeedCount);
+
+   // Every worker owns a generator, so grids and random streams are never shared. Seeds are
+   // handed out one at a time because generation time varies a lot between seeds.
+   const int32 NumWorkers = FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, SeedCount);
+   FThreadSafeCounter NextSeed;
+
+   const double StartTime = FPlatformTime::Seconds();
+
+   ParallelFor(NumWorkers, [&](int32 Worker)
+   {
+      FDungeonGenerator Generator = Settings;
+
+      for (;;)
+      {
+         const int32 Index = NextSeed.Increment() - 1;
+         if (Index >= SeedCount)
+            break;
+
+         Generator.Seed = SeedStart + Index;
+         Generator.Generate();
+         Results[Index] = Generator.GetStats();
+
+         if (bAscii)
+            SaveAscii(Generator, FPaths::Combine(OutDir, FString::Printf(TEXT("Seed_%d.txt"), Generator.Seed)));
+         if (ImageWrapperModule)
+            SavePng(*ImageWrapperModule, Generator, FPaths::Combine(OutDir, FString::Printf(TEXT("Seed_%d.png"), Generator.Seed)));
+      }
+   });
+
+   const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+   FString Csv = TEXT("Seed,FeaturesPlaced,FailedTries,Rooms,Corridors,UpStairs,DownStairs\n");
+   int32 MissingStairs = 0;
+
+   for (auto Index = 0; Index != SeedCount; ++Index)
+   {
+      const auto& Stats = Results[Index];
+      Csv += FString::Printf(TEXT("%d,%d,%d,%d,%d,%d,%d\n"), SeedStart + Index, Stats.FeaturesPlaced, Stats.FailedTries,
+         Stats.Rooms, Stats.Corridors, Stats.bUpStairs ? 1 : 0, Stats.bDownStairs ? 1 : 0);
+
+      if (!Stats.bUpStairs || !Stats.bDownStairs)
+         ++MissingStairs;
+   }
+
+   const FString CsvFile = FPaths::Combine(OutDir, TEXT("DungeonSweep.csv"));
+   if (!FFileHelper::SaveStringToFile(Csv, *CsvFile))
+   {
+      UE_LOG(Logroguelike, Error, TEXT("DungeonSweep: failed to write %s"), *CsvFile);
+      return 1;
+   }
+
+   UE_LOG(Logroguelike, Display, TEXT("DungeonSweep: %d seeds of %dx%d on %d workers in %.2f s (%.1f seeds/s), %d without both stairs, stats in %s"),
+      SeedCount, Settings.XSize, Settings.YSize, NumWorkers, Seconds, SeedCount / FMath::Max(Seconds, 1e-6), MissingStairs, *CsvFile);
+
+   return 0;
+}
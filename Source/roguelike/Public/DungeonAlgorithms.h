@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonBitGrid.h"
+#include "DungeonRng.h"
+
+class FDungeonGenerator;
+
+/**
+ * Layout policies of FDungeonGenerator, one per EDungeonAlgorithm.
+ *
+ * A policy lays out the rooms and corridors of an empty map through the generator's carving methods
+ * (AddRoom(), AddCorridor(), SetCells()), the generator places the stairs and fills the layers after
+ * it. FDungeonGenerator::MakeDungeon() is a template over the policy and picks the instantiation once
+ * per run, so the loops of a policy are compiled for it alone without any virtual dispatch. Policies
+ * keep their scratch buffers between runs.
+ */
+
+/** Rooms and corridors grown from the walls of what is already built, the original algorithm. */
+class ROGUELIKE_API FDungeonAccretionPolicy
+{
+public:
+   void Layout(FDungeonGenerator& Generator);
+};
+
+/**
+ * Binary space partition: the map is split in two along its longer side until the cells are small
+ * enough for MaxFeatures features, every cell gets one room. The two halves of each split are joined
+ * by a corridor between the rooms closest to the split line, which keeps every room reachable and
+ * corridors from crossing rooms.
+ */
+class ROGUELIKE_API FDungeonBspPolicy
+{
+public:
+   FDungeonBspPolicy() : TargetArea_(0), Features_(0) {}
+
+   void Layout(FDungeonGenerator& Generator);
+
+private:
+   struct FRoom
+   {
+      FIntPoint Min;
+      FIntPoint Max;
+      int32 Region;
+   };
+
+   /** Partitions the inclusive rectangle and places its rooms and corridors, recursing into both halves. */
+   void Split(FDungeonGenerator& Generator, const FIntPoint& Min, const FIntPoint& Max);
+
+   /** Joins the rooms [Begin, Middle) to [Middle, End) across the split line at Split. */
+   void Connect(FDungeonGenerator& Generator, bool bVertical, int32 Split, int32 Begin, int32 Middle, int32 End);
+
+   FDungeonRng Rng_;
+   int32 TargetArea_;
+   int32 Features_;
+   std::vector<FRoom> Rooms_;
+};
+
+/**
+ * Caverns carved by random walks: MaxFeatures walks start on already carved floor and stagger in
+ * random directions until CoveragePercent of the map is floor. Floor is carved in a bit grid first and
+ * copied to the map in one go, with walls around it.
+ */
+class ROGUELIKE_API FDungeonDrunkardPolicy
+{
+public:
+   // Share of the map inside the border that ends up as floor
+   static const int32 CoveragePercent = 40;
+
+   void Layout(FDungeonGenerator& Generator);
+
+private:
+   FDungeonBitGrid Floor_;
+   FDungeonBitGrid Wall_;
+
+   // Carved cells, walks start on a random one
+   std::vector<int32> Carved_;
+};
+
+/**
+ * Caves grown by a cellular automaton: 44% of the tiles start as rock, then every smoothing pass turns
+ * a tile into rock when at least five of the nine tiles around it, itself included, are rock. Outside
+ * the map counts as rock. Only the largest open area is kept, smaller pockets are filled in.
+ *
+ * The grid is a bitset and a pass counts the rock around 64 tiles at once with a bit sliced adder
+ * tree: the three rows above each other are summed per column first, then three neighbouring
+ * column sums, in about twenty word operations per 64 tiles. Rows are split across worker threads.
+ */
+class ROGUELIKE_API FDungeonCellularPolicy
+{
+public:
+   FDungeonCellularPolicy() : RootOfLargest_(-1) {}
+
+   void Layout(FDungeonGenerator& Generator);
+
+private:
+   /** Horizontal run of open tiles, Parent links the runs of one open area. */
+   struct FRun
+   {
+      int32 y;
+      int32 xStart;
+      int32 xEnd;
+      int32 Parent;
+   };
+
+   /** One smoothing pass from Rock_ into Next_. */
+   void Smooth();
+
+   /**
+    * Finds the open areas of Rock_ with a union find over row runs, sets Floor_ to the largest one and returns its bounds.
+    * Returns false if no tile is open.
+    */
+   bool KeepLargestCave(FIntPoint& OutMin, FIntPoint& OutMax);
+
+   int32 FindRoot(int32 Run);
+
+   FDungeonBitGrid Rock_;
+   FDungeonBitGrid Next_;
+   FDungeonBitGrid Floor_;
+   FDungeonBitGrid Wall_;
+
+   std::vector<FRun> Runs_;
+   std::vector<int32> RowStarts_;
+   std::vector<int32> Sizes_;
+   int32 RootOfLargest_;
+};
@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonBenchmarkCommandlet.generated.h"
+
+/**
+ * Times FDungeonGenerator over a matrix of layout algorithms, map sizes, feature counts, room chances
+ * and placement strategies, without a world. Room chances and sampling only vary for accretion.
+ *
+ *   UE4Editor-Cmd roguelike.uproject -run=DungeonBenchmark [-Algorithms=Accretion,BSP,Drunkard,Cellular
+ *      -Sizes=80x25,256x256,1024x1024,4096x4096 -Features=100,1000,10000 -ChanceRoom=25,50,75 -Repeats=5 -Out=<file>
+ *      -Layers]
+ *
+ * Every configuration runs once to warm up and then Repeats times. One CSV row per configuration
+ * goes to <Out>, default Saved/DungeonBenchmark.csv, with wall time, heap allocations, tries per
+ * placed feature, cells per second and the bytes per cell of the tile grid and its frontier. -Layers
+ * also fills the generated layers and records the graph.
+ * The timed runs repeat the warm up seed and should not allocate apart from the tasks of parallel
+ * passes, a configuration that does is logged and makes the commandlet return 1, so CI can gate on it.
+ *
+ * A second pass times FDungeonFieldOfView on a -FovSize map from -FovSamples walkable tiles with
+ * radius -FovRadius (defaults 1024, 10000, 20) and writes min/mean/median/p99 microseconds to
+ * <Out>_Fov.csv.
+ *
+ * A third pass times the instance transforms Build() computes, see ADungeonMapActor::ComputeBuildTransforms(),
+ * on a map of every algorithm and size with the largest feature count. Rows for 64 tile chunks and a single
+ * chunk, each with and without merged walls, go to <Out>_Build.csv.
+ */
+UCLASS()
+class ROGUELIKE_API UDungeonBenchmarkCommandlet : public UCommandlet
+{
+   GENERATED_BODY()
+
+public:
+   UDungeonBenchmarkCommandlet();
+
+   virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+
+/**
+ * One bit per tile, stored as rows of 64 bit words.
+ * Rows are padded to whole words so rectangle queries touch at most a couple of words per row.
+ */
+class ROGUELIKE_API FDungeonBitGrid
+{
+public:
+   FDungeonBitGrid();
+
+   /** Resizes the grid and clears every bit. */
+   void Init(int32 InXSize, int32 InYSize);
+
+   bool Get(int32 x, int32 y) const
+   {
+      return (Words_[Index(x, y)] >> (x & 63)) & 1;
+   }
+
+   void Set(int32 x, int32 y, bool bValue)
+   {
+      const uint64 Bit = uint64(1) << (x & 63);
+      uint64& Word = Words_[Index(x, y)];
+      Word = bValue ? (Word | Bit) : (Word & ~Bit);
+   }
+
+   /** Sets or clears the inclusive rectangle. */
+   void SetRect(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, bool bValue);
+
+   /** True if any bit in the inclusive rectangle is set. */
+   bool AnyInRect(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd) const;
+
+   // Whole grid operations, both grids must have the same size. They run over
+   // plain word arrays so the compiler is free to vectorise them.
+   void Or(const FDungeonBitGrid& Other);
+   void AndNot(const FDungeonBitGrid& Other);
+
+   /** Sets the bits of all tiles that have one of their four neighbours set in Source. */
+   void SetAdjacent(const FDungeonBitGrid& Source);
+
+   /** Sets the bits of all tiles that are set in Source or have one of their eight neighbours set. */
+   void SetSurrounding(const FDungeonBitGrid& Source);
+
+   int32 GetXSize() const { return XSize_; }
+   int32 GetYSize() const { return YSize_; }
+   int32 GetWordsPerRow() const { return WordsPerRow_; }
+   int64 GetAllocatedSize() const { return int64(Words_.capacity()) * sizeof(uint64); }
+
+   /** Words of a row for word parallel passes. Bits past XSize in the last word must stay clear. */
+   uint64* GetRow(int32 y) { return &Words_[WordsPerRow_ * y]; }
+   const uint64* GetRow(int32 y) const { return &Words_[WordsPerRow_ * y]; }
+
+   /** Valid bits of the last word in a row, padding bits must stay clear. */
+   uint64 TailMask() const { return (XSize_ & 63) ? RangeMask(0, (XSize_ & 63) - 1) : ~uint64(0); }
+
+private:
+   int32 Index(int32 x, int32 y) const { return (x >> 6) + WordsPerRow_ * y; }
+
+   /** Bits lo..hi (inclusive) of a word. */
+   static uint64 RangeMask(int32 lo, int32 hi)
+   {
+      return (~uint64(0) << lo) & (~uint64(0) >> (63 - hi));
+   }
+
+   int32 XSize_;
+   int32 YSize_;
+   int32 WordsPerRow_;
+   std::vector<uint64> Words_;
+};
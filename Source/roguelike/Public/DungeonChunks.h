@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.h"
+#include "DungeonGenerator.h"
+
+/**
+ * Deterministic chunk source for the endless map mode.
+ *
+ * Every chunk owns a plan: the accretion generator run on a window of (ChunkSize + 2 * Margin)^2
+ * tiles centred on the chunk, drawing from the random stream of Seed selected by the chunk coordinate. Features may spill
+ * into the margin, so a chunk is materialised by merging its own plan with the plans of its eight
+ * neighbours. The merge keeps the highest ranked tile per cell, which makes the result independent
+ * of the order in which chunks are requested.
+ *
+ * Each plan carves corridors from the four border portals to its centre. Portal positions are a
+ * function of the shared edge, so corridors of neighbouring chunks always meet and the streamed
+ * world stays connected.
+ */
+class ROGUELIKE_API FDungeonChunkPlanner
+{
+public:
+   FDungeonChunkPlanner();
+
+   int32 Seed;
+   int32 ChunkSize;
+   int32 Margin;
+   int32 MaxFeatures;
+   int32 ChanceRoom;
+   int32 ChanceCorridor;
+   EFeatureSampling Sampling;
+
+   /** Upper bound of cached plans, each one holds (ChunkSize + 2 * Margin)^2 tiles. */
+   int32 MaxCachedPlans;
+
+   /** Fills OutCells with the ChunkSize x ChunkSize tiles of chunk Coord, row major. */
+   void BuildChunk(const FIntPoint& Coord, std::vector<ETileType>& OutCells);
+
+   /** Drops cached plans, required after any property change. */
+   void Reset();
+
+   static uint64 GetChunkKey(const FIntPoint& Coord);
+   static int32 FloorDiv(int32 Value, int32 Divisor);
+
+   /** Merge priority, walkable tiles always win over walls so connectivity survives the merge. */
+   static int32 GetTileRank(ETileType tile);
+
+private:
+   // A plan slot, LastUse is 0 while the slot is free
+   struct FPlan
+   {
+      FPlan() : Key(0), LastUse(0) {}
+
+      uint64 Key;
+      std::vector<ETileType> Cells;
+      uint64 LastUse;
+   };
+
+   const std::vector<ETileType>& GetPlan(const FIntPoint& Coord);
+   void MakePlan(const FIntPoint& Coord, std::vector<ETileType>& OutCells);
+
+   /** Offset of the portal along the east (bSouth == false) or south edge of chunk (cx, cy). */
+   int32 GetPortal(int32 cx, int32 cy, bool bSouth) const;
+   uint64 Hash(int32 cx, int32 cy, uint32 salt) const;
+
+   /** Carves an L shaped corridor, stops as soon as it enters a room. */
+   void CarvePath(int32 xFrom, int32 yFrom, int32 xTo, int32 yTo, bool bHorizontalFirst);
+   bool CarveStep(int32 x, int32 y, int32 xNext, int32 yNext);
+
+   FDungeonGenerator Generator_;
+   // At most max(MaxCachedPlans, 9) slots searched linearly, a new plan recycles the least recently used slot and its buffer
+   std::vector<FPlan> Plans_;
+   uint64 UseCounter_;
+};
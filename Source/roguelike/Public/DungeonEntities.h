@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.h"
+
+/**
+ * Monsters, items and traps of a dungeon as plain data instead of actors.
+ *
+ * Every property is an array indexed by entity slot, a system only streams through the arrays it
+ * needs. Slots of despawned entities are reused, ids carry a generation to catch stale ones.
+ * A spatial hash keyed by tile finds the entities on a tile, its size follows the entity count and
+ * not the map. Entities with a speed take turns from a priority queue ordered by the time of their
+ * next turn, so advancing the clock only touches the entities that act.
+ */
+class ROGUELIKE_API FDungeonEntities
+{
+public:
+   // Time an action takes at speed 100, e.g. one player move
+   static const int32 TurnTime = 100;
+
+   FDungeonEntities();
+
+   /** Removes every entity and restarts the clock. Tiles are on a grid XSize tiles wide. */
+   void Reset(int32 InXSize);
+
+   /** Adds an entity, one with a speed > 0 gets its first turn one action from now. */
+   FDungeonEntityId Spawn(EDungeonEntityKind Kind, int32 Type, const FIntPoint& Tile, int32 Speed);
+   bool Despawn(const FDungeonEntityId& Id);
+   bool IsValid(const FDungeonEntityId& Id) const;
+
+   void Move(int32 Slot, const FIntPoint& Tile);
+
+   int32 Num() const { return NumAlive_; }
+   int32 GetNumSlots() const { return int32(Generation_.size()); }
+
+   // Per slot data, valid for slots of alive entities
+   bool IsAlive(int32 Slot) const { return Alive_[Slot] != 0; }
+   FIntPoint GetTile(int32 Slot) const { return FIntPoint(Cell_[Slot] % XSize_, Cell_[Slot] / XSize_); }
+   EDungeonEntityKind GetKind(int32 Slot) const { return Kind_[Slot]; }
+   int32 GetType(int32 Slot) const { return Type_[Slot]; }
+   int32 GetSpeed(int32 Slot) const { return Speed_[Slot]; }
+   FDungeonEntityId GetId(int32 Slot) const { return FDungeonEntityId(Slot, Generation_[Slot]); }
+
+   /** Calls Visit(Slot) for every entity on the tile until it returns false. */
+   template <typename FunctionType>
+   void ForEachAt(const FIntPoint& Tile, FunctionType Visit) const
+   {
+      const auto Cell = Tile.X + XSize_ * Tile.Y;
+      for (auto Slot = Buckets_.empty() ? -1 : Buckets_[Hash(Cell)]; Slot >= 0; Slot = NextInBucket_[Slot])
+         if (Cell_[Slot] == Cell && !Visit(Slot))
+            return;
+   }
+
+   /** First entity of a kind on the tile, -1 if there is none. */
+   int32 FindAt(const FIntPoint& Tile, EDungeonEntityKind Kind) const;
+
+   int64 GetTime() const { return Time_; }
+
+   /**
+    * Advances the clock by Duration and gives a turn to every entity due until then, in the order of
+    * their turns. Act(Slot) carries out the action and returns the time it takes at speed 100, or 0 to
+    * end the entity's turns. Entities may be spawned, moved and despawned from Act. Returns the
+    * number of turns taken.
+    */
+   template <typename FunctionType>
+   int32 RunTurns(int64 Duration, FunctionType Act)
+   {
+      const int64 End = Time_ + Duration;
+      int32 Turns = 0;
+
+      while (!Queue_.empty() && Queue_.front().Time <= End)
+      {
+         std::pop_heap(Queue_.begin(), Queue_.end());
+         const FTurn Turn = Queue_.back();
+         Queue_.pop_back();
+
+         // Despawned since the turn was queued.
+         if (Generation_[Turn.Slot] != Turn.Generation || !Alive_[Turn.Slot])
+            continue;
+
+         Time_ = Turn.Time;
+         ++Turns;
+
+         const int32 Cost = Act(Turn.Slot);
+         if (Cost > 0 && Alive_[Turn.Slot] && Generation_[Turn.Slot] == Turn.Generation)
+            Schedule(Turn.Slot, Turn.Time + int64(Cost) * TurnTime / Speed_[Turn.Slot]);
+      }
+
+      Time_ = End;
+      return Turns;
+   }
+
+private:
+   struct FTurn
+   {
+      int64 Time;
+      int32 Slot;
+      int32 Generation;
+
+      // Max heap on the inverse order: earliest time first, ties in slot order for reproducible runs.
+      bool operator<(const FTurn& Other) const { return Time != Other.Time ? Time > Other.Time : Slot > Other.Slot; }
+   };
+
+   int32 Hash(int32 Cell) const { return int32((uint32(Cell) * 2654435761u) >> HashShift_); }
+
+   void Link(int32 Slot);
+   void Unlink(int32 Slot);
+
+   /** Grows the hash so it has at least two buckets per entity. */
+   void Rehash(int32 MinBuckets);
+
+   void Schedule(int32 Slot, int64 Time);
+
+   int32 XSize_;
+   int32 NumAlive_;
+   int64 Time_;
+
+   std::vector<int32> Cell_;
+   std::vector<EDungeonEntityKind> Kind_;
+   std::vector<int32> Type_;
+   std::vector<int32> Speed_;
+   std::vector<int32> Generation_;
+   std::vector<uint8> Alive_;
+   std::vector<int32> FreeSlots_;
+
+   // Spatial hash, a singly linked list of slots per bucket
+   std::vector<int32> Buckets_;
+   std::vector<int32> NextInBucket_;
+   int32 HashShift_;
+
+   std::vector<FTurn> Queue_;
+};
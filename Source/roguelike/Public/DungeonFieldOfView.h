@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonBitGrid.h"
+
+/**
+ * Recursive shadowcasting field of view with visible and explored tile sets.
+ *
+ * Each of the eight octants is scanned row by row outwards from the origin, and blocked tiles
+ * narrow the slope window of the rows behind them. Blocking tiles are lit themselves, so walls
+ * bounding a room are visible. Only the square touched by the previous Compute() is cleared,
+ * which keeps the cost proportional to the radius rather than the map.
+ */
+class ROGUELIKE_API FDungeonFieldOfView
+{
+public:
+   FDungeonFieldOfView();
+
+   /** Resizes both sets and forgets everything explored so far. */
+   void Reset(int32 XSize, int32 YSize);
+
+   /**
+    * Recomputes the visible set around Origin. Tiles set in Transparent let light through.
+    * Tiles seen for the first time are appended to OutNewlyExplored as x + XSize * y, if given.
+    */
+   void Compute(const FDungeonBitGrid& Transparent, const FIntPoint& Origin, int32 Radius, std::vector<int32>* OutNewlyExplored = nullptr);
+
+   const FDungeonBitGrid& GetVisible() const { return Visible_; }
+   const FDungeonBitGrid& GetExplored() const { return Explored_; }
+
+private:
+   void CastLight(int32 Row, float Start, float End, int32 xx, int32 xy, int32 yx, int32 yy);
+   void Light(int32 x, int32 y);
+
+   bool IsInside(int32 x, int32 y) const
+   {
+      return x >= 0 && y >= 0 && x < Visible_.GetXSize() && y < Visible_.GetYSize();
+   }
+
+   FDungeonBitGrid Visible_;
+   FDungeonBitGrid Explored_;
+
+   // Square lit by the last Compute(), inclusive
+   int32 LitMinX_;
+   int32 LitMinY_;
+   int32 LitMaxX_;
+   int32 LitMaxY_;
+
+   // Inputs of the running Compute()
+   const FDungeonBitGrid* Transparent_;
+   FIntPoint Origin_;
+   int32 Radius_;
+   std::vector<int32>* NewlyExplored_;
+};
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonBitGrid.h"
+
+/**
+ * Dijkstra map over a walkable bit grid: the number of steps from every tile to the nearest goal,
+ * eight directions without cutting corners like FDungeonPathfinder.
+ *
+ * One field is shared by every agent chasing the same goals. It is computed once per goal move with
+ * a bucket queue, steps have unit cost so the queue needs no heap. Reading the next step of an agent
+ * only looks at the eight neighbours of its tile, so the cost per agent does not depend on the map.
+ * Only tiles reached by the last run are reset before the next one, bounded fields stay cheap on
+ * large maps.
+ */
+class ROGUELIKE_API FDungeonFlowField
+{
+public:
+   static const int32 Unreached = MAX_int32;
+
+   FDungeonFlowField();
+
+   /** Steps to the nearest of Goals, tiles further than MaxRadius steps away stay unreached. */
+   void Compute(const FDungeonBitGrid& Walkable, const std::vector<FIntPoint>& Goals, int32 MaxRadius = MAX_int32);
+
+   /**
+    * Safety map of Toward: rescans its distances scaled by -Coefficient, so walking downhill leads away
+    * from the goals of Toward but prefers open areas over dead ends. Coefficients above 1 make agents
+    * slip past the goal rather than getting cornered.
+    */
+   void ComputeFlee(const FDungeonBitGrid& Walkable, const FDungeonFlowField& Toward, float Coefficient = 1.2f);
+
+   int32 GetDistance(int32 x, int32 y) const
+   {
+      return x >= 0 && y >= 0 && x < XSize_ && y < YSize_ ? Distance_[x + XSize_ * y] : Unreached;
+   }
+
+   /**
+    * Neighbour of Tile with the smallest distance, false if Tile is unreached or no neighbour is closer.
+    * Diagonals are only taken when both tiles beside them are reached.
+    */
+   bool GetNextStep(const FIntPoint& Tile, FIntPoint& OutStep) const;
+
+   bool IsComputed() const { return !Distance_.empty(); }
+
+   /** Tiles that got a distance in the last run. */
+   int32 GetLastReached() const { return int32(Reached_.size()); }
+
+private:
+   struct FSeed
+   {
+      int32 Cell;
+      int32 Cost;
+   };
+
+   /** Resets the tiles of the last run and floods from Seeds_ up to MaxCost. */
+   void Run(const FDungeonBitGrid& Walkable, int32 MaxCost);
+
+   int32 XSize_;
+   int32 YSize_;
+   std::vector<int32> Distance_;
+
+   // Tiles with a distance, the only ones the next run has to reset
+   std::vector<int32> Reached_;
+
+   // Bucket d holds the tiles queued with distance d, stale entries are skipped when popped
+   std::vector<std::vector<int32>> Buckets_;
+   std::vector<FSeed> Seeds_;
+};
@@ -0,0 +1,262 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.h"
+#include "DungeonBitGrid.h"
+#include "DungeonLayers.h"
+#include "DungeonGraph.h"
+#include "DungeonRng.h"
+#include "DungeonAlgorithms.h"
+
+using RngT = FDungeonRng;
+
+/** Counters of the last Generate() run. */
+struct FDungeonStats
+{
+   FDungeonStats()
+      : FeaturesPlaced(0), FailedTries(0), RejectedTile(0), RejectedDoor(0), RejectedBounds(0), RejectedArea(0)
+      , StairTries(0), Rooms(0), Corridors(0), bUpStairs(false), bDownStairs(false)
+   {
+   }
+
+   int32 FeaturesPlaced;
+   int32 FailedTries;
+
+   // Why tries failed: anchor not a wall or corridor (or not reachable), anchor next to a door,
+   // feature leaving the map, feature overlapping used tiles
+   int32 RejectedTile;
+   int32 RejectedDoor;
+   int32 RejectedBounds;
+   int32 RejectedArea;
+
+   int32 StairTries;
+   int32 Rooms;
+   int32 Corridors;
+   bool bUpStairs;
+   bool bDownStairs;
+};
+
+/**
+ * Dungeon generator, room and corridor accretion unless another Algorithm is selected.
+ * Works on a plain XSize x YSize tile grid and has no UObject dependencies, so the same
+ * algorithm can fill the whole map of ADungeonMapActor or a single streamed chunk.
+ * The layout algorithms are policies in DungeonAlgorithms.h that carve through the methods below.
+ *
+ * Keep a generator around to regenerate: the grid, the layers, the graph and the scratch buffers of
+ * the generator and its policies only ever grow, so once a run has sized them, another run at the
+ * same or a smaller size does not touch the heap.
+ */
+class ROGUELIKE_API FDungeonGenerator
+{
+public:
+   FDungeonGenerator();
+
+   // Maps smaller than this run their word parallel passes on the calling thread, the tasks would
+   // cost more than they save and allocate on every dispatch.
+   static const int32 MinParallelCells = 512 * 512;
+
+   // Generator properties
+   int32 Seed;
+   // Selects one of the independent random streams of Seed, e.g. one per chunk or floor
+   uint64 Stream;
+   int32 XSize;
+   int32 YSize;
+   int32 MaxFeatures;
+   int32 ChanceRoom;
+   int32 ChanceCorridor;
+   EFeatureSampling Sampling;
+   ETileStorage Storage;
+   // Layout of MakeDungeon(). MaxFeatures bounds the features of every algorithm, ChanceRoom, ChanceCorridor
+   // and Sampling only apply to accretion.
+   EDungeonAlgorithm Algorithm;
+   // Smoothing passes of DA_Cellular
+   int32 CaveIterations;
+   // Layers filled by Generate(), one bit per EDungeonLayer: DL_RoomId, DL_RegionId and DL_EntranceDistance
+   int32 GeneratedLayers;
+   // Record rooms, corridors and doors in GetGraph(). Doors are resolved through the RegionId layer, which is allocated too.
+   bool bRecordGraph;
+
+   /** Optional flag polled between features, lets another thread abort a running Generate(). */
+   const std::atomic<bool>* CancelFlag;
+
+   bool IsCancelled() const { return CancelFlag && CancelFlag->load(std::memory_order_relaxed); }
+
+   /** Allocates an empty grid and seeds the random stream without running the algorithm. */
+   void Reset();
+
+   /** Reset() followed by the full dungeon algorithm. */
+   void Generate();
+
+   void SetCell(int32 x, int32 y, ETileType celltype);
+   ETileType GetCell(int32 x, int32 y) const;
+   void SetCells(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, ETileType cellType);
+   bool IsXInBounds(int32 x) const;
+   bool IsYInBounds(int32 y) const;
+   bool IsAreaUnused(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd) const;
+   bool IsAdjacent(int32 x, int32 y, ETileType tile) const;
+   void SetCellMeta(int32 x, int32 y, FTileMeta celltype);
+   FTileMeta GetCellMeta(int32 x, int32 y) const;
+
+   /** Per tile data next to the grid, sized by Reset(). FTileMeta lives in the Direction layer. */
+   FDungeonLayers& GetLayers() { return Layers_; }
+   const FDungeonLayers& GetLayers() const { return Layers_; }
+
+   /** Rooms, corridors and doors of the last Generate(), empty unless bRecordGraph is set. */
+   const FDungeonGraph& GetGraph() const { return Graph_; }
+
+   /** First tile of the given type in row major order, e.g. the stairs placed by MakeStairs(). */
+   bool FindTile(ETileType tile, FIntPoint& OutTile) const;
+
+   int32 GetRandomInt(int32 min, int32 max);
+   EDirection GetRandomDirection();
+
+   /**
+    * Random stream that depends on (Seed, Stream, Id) only, not on how far the main stream has
+    * advanced. Work that runs in parallel draws from its own substream to stay reproducible.
+    */
+   RngT GetSubstream(uint64 Id) const;
+   bool MakeCorridor(int32 x, int32 y, int32 maxLength, EDirection direction);
+   bool MakeRoom(int32 x, int32 y, int32 xMaxLength, int32 yMaxLength, EDirection direction);
+   bool MakeFeature(int32 x, int32 y, int32 xmod, int32 ymod, EDirection direction);
+   /** Records the door of the feature that was just placed behind the anchor (x, y). */
+   void AddDoor(int32 x, int32 y, int32 xmod, int32 ymod);
+
+   // Carving for the layout policies. Rectangles are inclusive and not checked against what is already
+   // there, the returned region numbers the RegionId layer uses start at 1.
+
+   /** Room with walls on its border and floor inside. */
+   int32 AddRoom(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd);
+   int32 AddCorridor(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd);
+
+   /** Counts a region whose tiles the caller set and records it in the graph. */
+   int32 AddRegion(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, bool bRoom);
+
+   /**
+    * Replaces the whole grid at once: tiles set in Floor become floor, tiles set in Wall walls and all
+    * others unused. Bit plane storage takes the masks as they are, byte rows are filled in parallel.
+    */
+   void SetCells(const FDungeonBitGrid& Floor, const FDungeonBitGrid& Wall);
+
+   /** Records a passage between two regions in the graph, e.g. a door or where two corridors meet. */
+   void AddDoor(const FIntPoint& Tile, int32 FromRegion, int32 ToRegion);
+
+   void AddFeaturesPlaced(int32 Count) { Stats_.FeaturesPlaced += Count; }
+   bool MakeFeature();
+
+   /**
+    * A valid anchor is a wall or corridor tile with no adjacent door and a walkable neighbour.
+    * Returns the direction a feature would grow in and the offset of its first tile.
+    */
+   bool GetAnchor(int32 x, int32 y, int32& xmod, int32& ymod, EDirection& direction) const;
+
+   /** Places up to Count features, returns how many were placed. */
+   int32 MakeFeatures(int32 Count);
+   bool MakeStairs(ETileType tile);
+
+   /** Lays out the map with the policy of Algorithm and places the stairs. */
+   bool MakeDungeon();
+
+   /** Fills the EntranceDistance layer with a breadth first search from the up stairs. */
+   void ComputeEntranceDistance();
+
+   /**
+    * Sets Out to all tiles whose type is in TileMask, one bit per ETileType (1 << tile). Decoded a word
+    * at a time from the bit planes, requires TS_BitPlanes storage.
+    */
+   void GetTiles(uint32 TileMask, FDungeonBitGrid& Out) const;
+
+   /** Sets Out to all tiles that can be walked on: floors, corridors, doors and stairs. */
+   void GetWalkable(FDungeonBitGrid& Out) const;
+
+   /** Bytes held by the tile grid and the structures kept in step with it, the layers and the graph not included. */
+   int64 GetGridAllocatedSize() const;
+
+   /** Byte grid, empty with TS_BitPlanes storage. */
+   const std::vector<ETileType>& GetData() const { return Data_; }
+
+   const FDungeonStats& GetStats() const { return Stats_; }
+
+private:
+   std::vector<ETileType> Data_;
+   FDungeonLayers Layers_;
+   FDungeonGraph Graph_;
+
+   // Set for every tile that is not TE_Unused, kept current by SetCell()/SetCells() for IsAreaUnused().
+   // Byte storage only, bit planes answer it from the OR of their planes.
+   FDungeonBitGrid Used_;
+
+   // TS_BitPlanes storage: the tile type as a three bit number, plane i holds bit i of every tile. Data_ stays empty.
+   static const int32 NumPlanes = 3;
+   FDungeonBitGrid Planes_[NumPlanes];
+
+   // Scratch planes for MakeStairs()
+   FDungeonBitGrid Candidates_;
+   FDungeonBitGrid Scratch_;
+   FDungeonBitGrid Tiles_;
+
+   /**
+    * Slot of a tile in Anchors_, open addressing with linear probing keyed by cell index. It holds the
+    * frontier only, not the map, and keeps its capacity across runs like the other buffers.
+    */
+   class FAnchorSlots
+   {
+   public:
+      FAnchorSlots() : Num_(0), Shift_(32) {}
+
+      /** Removes every entry, keeps the table. */
+      void Reset();
+
+      /** Slot of the cell, -1 if it is not in the frontier. */
+      int32 Find(int32 Cell) const;
+
+      /** Adds the cell or changes its slot. */
+      void Set(int32 Cell, int32 Slot);
+
+      void Remove(int32 Cell);
+
+      int64 GetAllocatedSize() const { return int64(Entries_.capacity()) * sizeof(FEntry); }
+
+   private:
+      struct FEntry
+      {
+         int32 Cell;
+         int32 Slot;
+      };
+
+      uint32 Home(int32 Cell) const { return Shift_ < 32 ? (uint32(Cell) * 2654435769u) >> Shift_ : 0; }
+      void Grow();
+
+      std::vector<FEntry> Entries_;
+      int32 Num_;
+      int32 Shift_;
+   };
+
+   // Frontier of valid anchor tiles (cell indices) and the slot of every tile in it.
+   // Only maintained with FS_Frontier sampling.
+   std::vector<int32> Anchors_;
+   FAnchorSlots AnchorSlots_;
+   bool bTrackAnchors_;
+
+   // Breadth first queue of ComputeEntranceDistance()
+   std::vector<int32> DistanceQueue_;
+
+   /** Re-evaluates the anchors of the inclusive rectangle grown by one tile. */
+   void UpdateAnchors(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd);
+
+   // One instance of every layout policy, their scratch buffers are reused by the next run
+   FDungeonAccretionPolicy Accretion_;
+   FDungeonBspPolicy Bsp_;
+   FDungeonDrunkardPolicy Drunkard_;
+   FDungeonCellularPolicy Cellular_;
+
+   template <typename PolicyType>
+   bool MakeDungeon(PolicyType& Policy);
+
+   FDungeonStats Stats_;
+   RngT rnd_;
+};
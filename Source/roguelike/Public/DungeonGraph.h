@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.h"
+
+/**
+ * Rooms and corridors as nodes and the doors between them as edges, recorded by FDungeonGenerator
+ * while it carves the map. Questions about rooms are answered on the graph in O(regions) instead of
+ * scanning or flood filling the tile grid.
+ */
+class ROGUELIKE_API FDungeonGraph
+{
+public:
+   FDungeonGraph();
+
+   // Regions holding the stairs, -1 without stairs
+   int32 UpStairsRegion;
+   int32 DownStairsRegion;
+
+   void Reset();
+
+   /** Adds a node, regions are numbered in the order they are added. */
+   int32 AddRegion(const FDungeonRegion& Region);
+   void AddDoor(const FDungeonDoor& Door);
+
+   int32 NumRegions() const { return int32(Regions_.size()); }
+   const std::vector<FDungeonRegion>& GetRegions() const { return Regions_; }
+   const std::vector<FDungeonDoor>& GetDoors() const { return Doors_; }
+
+   /** Calls Visit(Door) for the doors of a region in the order they were added, Door indexes GetDoors(). */
+   template <typename FunctionType>
+   void ForEachDoor(int32 Region, FunctionType Visit) const
+   {
+      for (auto Link = FirstLink_[Region]; Link >= 0; Link = NextLink_[Link])
+         Visit(Link >> 1);
+   }
+
+   /** First region whose bounds contain the tile, -1 if none does. Doors belong to the region they were cut into. */
+   int32 FindRegion(int32 x, int32 y) const;
+
+   /** Doors to pass from Start to every region, -1 for regions that cannot be reached. */
+   void GetHops(int32 Start, std::vector<int32>& OutHops) const;
+
+   /** Regions at most MaxHops doors away from Start, Start included, in order of their distance. */
+   void GetRegionsWithinHops(int32 Start, int32 MaxHops, bool bRoomsOnly, std::vector<int32>& OutRegions) const;
+
+   /** The room most doors away from Start, -1 if no room can be reached. */
+   int32 FindFarthestRoom(int32 Start) const;
+
+private:
+   /** Breadth first search from Start, calls Visit(Region, Hops) in order of distance until it returns false. */
+   template <typename FunctionType>
+   void Search(int32 Start, FunctionType Visit) const;
+
+   std::vector<FDungeonRegion> Regions_;
+   std::vector<FDungeonDoor> Doors_;
+
+   // Door list of every region as a linked list through the doors, so the lists share two flat arrays
+   // that stop growing after the first runs. Door d has link 2d in the list of its From region and
+   // link 2d + 1 in the one of its To region.
+   std::vector<int32> FirstLink_;
+   std::vector<int32> LastLink_;
+   std::vector<int32> NextLink_;
+};
@@ -0,0 +1,192 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.h"
+
+/**
+ * Dense per tile array of one plain value type, row major like the tile grid.
+ * Memory is cache line aligned and only allocated on the first write, until then every tile reads
+ * as the default value. Resizing keeps the allocation, so a layer filled once stays filled.
+ */
+template <typename ElementType>
+class TDungeonLayer
+{
+   static_assert(std::is_trivially_copyable<ElementType>::value, "Layers are copied and filled as raw memory");
+
+public:
+   explicit TDungeonLayer(ElementType InDefault = ElementType())
+      : Data_(nullptr), Capacity_(0), XSize_(0), YSize_(0), Default_(InDefault)
+   {
+   }
+
+   TDungeonLayer(const TDungeonLayer& Other)
+      : Data_(nullptr), Capacity_(0), XSize_(Other.XSize_), YSize_(Other.YSize_), Default_(Other.Default_)
+   {
+      if (Other.Data_)
+         FMemory::Memcpy(Allocate(), Other.Data_, Num() * sizeof(ElementType));
+   }
+
+   TDungeonLayer(TDungeonLayer&& Other)
+      : Data_(nullptr), Capacity_(0), XSize_(0), YSize_(0), Default_(Other.Default_)
+   {
+      Swap(Other);
+   }
+
+   TDungeonLayer& operator=(TDungeonLayer Other)
+   {
+      Swap(Other);
+      return *this;
+   }
+
+   ~TDungeonLayer() { Release(); }
+
+   void Swap(TDungeonLayer& Other)
+   {
+      std::swap(Data_, Other.Data_);
+      std::swap(Capacity_, Other.Capacity_);
+      std::swap(XSize_, Other.XSize_);
+      std::swap(YSize_, Other.YSize_);
+      std::swap(Default_, Other.Default_);
+   }
+
+   /** Sets the size and resets every tile to the default, an allocated layer stays allocated. */
+   void Resize(int32 InXSize, int32 InYSize)
+   {
+      XSize_ = InXSize;
+      YSize_ = InYSize;
+
+      if (Data_)
+      {
+         Reserve();
+         Fill(Default_);
+      }
+   }
+
+   /** Allocates the layer filled with the default, an allocated layer is returned as it is. */
+   ElementType* Allocate()
+   {
+      if (!Data_)
+      {
+         Reserve();
+         Fill(Default_);
+      }
+
+      return Data_;
+   }
+
+   void Release()
+   {
+      FMemory::Free(Data_);
+      Data_ = nullptr;
+      Capacity_ = 0;
+   }
+
+   bool IsAllocated() const { return Data_ != nullptr; }
+
+   ElementType Get(int32 x, int32 y) const
+   {
+      return Data_ ? Data_[x + XSize_ * y] : Default_;
+   }
+
+   void Set(int32 x, int32 y, ElementType Value)
+   {
+      if (!Data_)
+      {
+         // Writing the default to an unallocated layer changes nothing.
+         if (FMemory::Memcmp(&Value, &Default_, sizeof(ElementType)) == 0)
+            return;
+         Allocate();
+      }
+
+      Data_[x + XSize_ * y] = Value;
+   }
+
+   /** Sets the inclusive rectangle, like FDungeonGenerator::SetCells(). */
+   void SetRect(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, ElementType Value)
+   {
+      if (!Data_)
+         Allocate();
+
+      for (auto y = yStart; y <= yEnd; ++y)
+         std::fill(Data_ + xStart + XSize_ * y, Data_ + xEnd + 1 + XSize_ * y, Value);
+   }
+
+   void Fill(ElementType Value)
+   {
+      if (Data_)
+         std::fill(Data_, Data_ + Num(), Value);
+   }
+
+   /** Row major tiles for bulk passes, nullptr while the layer is unallocated. */
+   ElementType* GetData() { return Data_; }
+   const ElementType* GetData() const { return Data_; }
+
+   int32 Num() const { return XSize_ * YSize_; }
+   ElementType GetDefault() const { return Default_; }
+   int64 GetAllocatedSize() const { return int64(Capacity_) * sizeof(ElementType); }
+
+private:
+   void Reserve()
+   {
+      if (!Data_ || Num() > Capacity_)
+      {
+         FMemory::Free(Data_);
+         Capacity_ = Num();
+         Data_ = static_cast<ElementType*>(FMemory::Malloc(FMath::Max(Capacity_, 1) * sizeof(ElementType), PLATFORM_CACHE_LINE_SIZE));
+      }
+   }
+
+   ElementType* Data_;
+   int32 Capacity_;
+   int32 XSize_;
+   int32 YSize_;
+   ElementType Default_;
+};
+
+/**
+ * Per tile data kept next to the tile grid, one TDungeonLayer per kind of data instead of a struct
+ * per tile. Systems that only need one layer stream through just that layer, and layers nobody
+ * uses cost no memory.
+ */
+class ROGUELIKE_API FDungeonLayers
+{
+public:
+   FDungeonLayers();
+
+   // Direction a tile faces, e.g. doors and stairs. DE_North by default
+   TDungeonLayer<EDirection> Direction;
+
+   // Room the tile belongs to, 1 for the first room placed and 0 outside of rooms
+   TDungeonLayer<int32> RoomId;
+
+   // Room or corridor the tile belongs to, numbered in the order they were placed, 0 for none
+   TDungeonLayer<int32> RegionId;
+
+   // Steps from the up stairs over walkable tiles, MAX_int32 if unreachable
+   TDungeonLayer<int32> EntranceDistance;
+
+   TDungeonLayer<uint8> Light;
+
+   // Tiles the player has seen, written by the actor's field of view while fog of war is active
+   TDungeonLayer<bool> Explored;
+
+   /** Resizes every layer and resets it to its default, see TDungeonLayer::Resize(). */
+   void Resize(int32 XSize, int32 YSize);
+
+   /** Frees all layers. */
+   void Release();
+
+   bool IsAllocated(EDungeonLayer Layer) const;
+   void Allocate(EDungeonLayer Layer);
+
+   // Access by layer type for Blueprints and tools, values are converted to int32
+   int32 GetValue(EDungeonLayer Layer, int32 x, int32 y) const;
+   void SetValue(EDungeonLayer Layer, int32 x, int32 y, int32 Value);
+
+   int64 GetAllocatedSize() const;
+};
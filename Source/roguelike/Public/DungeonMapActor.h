@@ -3,26 +3,24 @@
 #pragma once
 
 #include <vector>
-#include <random>
+#include <unordered_map>
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Async/Future.h"
 #include "Components/InstancedStaticMeshComponent.h"
+#include "DungeonTypes.h"
+#include "DungeonGenerator.h"
+#include "DungeonChunks.h"
+#include "DungeonPathfinder.h"
+#include "DungeonFieldOfView.h"
+#include "DungeonFlowField.h"
+#include "DungeonEntities.h"
 #include "DungeonMapActor.generated.h"
 
 class UInstancedStaticMeshComponent;
 
-UENUM(BlueprintType)	
-enum class ETileType : uint8
-{
-   TE_Unused UMETA(DisplayName="Unused"),
-   TE_DirtWall UMETA(DisplayName="DirtWall"),
-	TE_DirtFloor UMETA(DisplayName="DirtFloor"),
-   TE_Corridor	UMETA(DisplayName="Corridor"),
-   TE_Door UMETA(DisplayName="Door"),
-   TE_UpStairs UMETA(DisplayName="UpStairs"),
-   TE_DownStairs UMETA(DisplayName="DownStairs")
-};
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnDungeonReady);
 
 USTRUCT(BlueprintType)
 struct FTileMesh
@@ -47,30 +45,6 @@ struct FTilesDefenition
    UPROPERTY(EditAnywhere) FTileMesh DownStairs;
 };
 
-using RngT = std::mt19937;
-
-UENUM(BlueprintType)
-enum class EDirection : uint8
-{
-   DE_North UMETA(DisplayName = "North"),
-   DE_South UMETA(DisplayName = "South"),
-   DE_East UMETA(DisplayName = "East"),
-   DE_West UMETA(DisplayName = "West"),
-   DE_NorthWest UMETA(DisplayName = "NorthWest"),
-   DE_NorthEast UMETA(DisplayName = "NorthEast"),
-   DE_SouthWest UMETA(DisplayName = "SouthWest"),
-   DE_SouthEast UMETA(DisplayName = "SouthEast")
-};
-
-
-USTRUCT(BlueprintType)
-struct FTileMeta
-{
-   GENERATED_BODY()
-   UPROPERTY(EditAnywhere) EDirection dir;
-};
-
-
 UCLASS()
 class ROGUELIKE_API ADungeonMapActor : public AActor
 {
@@ -83,6 +57,7 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
    // Generator properties
    UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) int32 Seed;
@@ -91,11 +66,72 @@ protected:
    UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) int32 MaxFeatures;
    UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) int32 ChanceRoom;
    UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) int32 ChanceCorridor;
+   UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) EFeatureSampling FeatureSampling;
+   UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) ETileStorage TileStorage;
+   // Layout algorithm, see DungeonAlgorithms.h. Endless maps always use accretion
+   UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) EDungeonAlgorithm Algorithm;
+   // Smoothing passes of the cellular automaton of Cellular Caves, more passes give rounder caves
+   UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties, meta = (ClampMin = "0")) int32 CaveIterations;
+   // Per tile layers filled while generating, see FDungeonLayers. Other layers are allocated on their first SetCellLayer()
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = MapProperties, meta = (Bitmask, BitmaskEnum = "EDungeonLayer")) int32 GeneratedLayers;
+   // Keep the rooms, corridors and doors of the generated map as a graph, see the region methods
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = MapProperties) bool bRecordGraph;
+   // Generate on a worker thread, the previous map stays readable until the new one is published
+   UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) bool bAsyncGeneration;
 	UPROPERTY(EditAnywhere, EditFixedSize, BlueprintReadWrite, Category = MapProperties) FTilesDefenition MeshDefenitions;
+   // Store the built map with the level, tiles set with SetCell() included. A loaded map is used instead of
+   // generating one until a generator property changes.
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = MapProperties) bool bSaveMap;
+
+   // Fog of war: in game only tiles the player has seen get instances, flat maps only, applied on Build()
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VisibilityProperties) bool bFogOfWar;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VisibilityProperties, meta = (ClampMin = "1")) int32 ViewRadius;
+
+   // Flow fields "Player" and "Flee" toward and away from the player, recomputed when the player enters another tile.
+   // Only tiles within FlowFieldRadius steps of the player are reached, 0 covers the whole map.
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, BlueprintSetter = SetPlayerFlowFields, Category = FlowFieldProperties) bool bPlayerFlowFields;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FlowFieldProperties, meta = (ClampMin = "0")) int32 FlowFieldRadius;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FlowFieldProperties, meta = (ClampMin = "1.0")) float FleeCoefficient;
+
+   // Mesh per entity type, entities of other types are not drawn. Only entities the player can see get an instance
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, BlueprintSetter = SetEntityMeshes, Category = EntityProperties) TArray<FTileMesh> EntityMeshes;
+
+   // Hierarchical instancing: one hierarchical instanced mesh per InstanceChunkSize x InstanceChunkSize tiles and tile type,
+   // so chunks and their clusters are frustum and distance culled and switch mesh LODs on their own. Cull distances of 0 never cull.
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties) bool bHierarchicalInstancing;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties, meta = (ClampMin = "8")) int32 InstanceChunkSize;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties, meta = (ClampMin = "0")) int32 InstanceStartCullDistance;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties, meta = (ClampMin = "0")) int32 InstanceEndCullDistance;
+
+   // Merge wall tiles into stretched instances covering runs and rectangles, walls no walkable tile touches are dropped.
+   // Stretched instances stretch their UVs too, so merging needs MergedWallMaterial: a wall material that maps its textures
+   // in world space (e.g. WorldAlignedTexture). It replaces the DirtWall material on merged walls, without it walls stay per tile.
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties) bool bMergeWalls;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = InstancingProperties) UMaterial* MergedWallMaterial;
+
+   // Multiple floors: stairs lead to the floors above and below, all generated from Seed with one random stream per floor.
+   // The floor behind stairs within PrefetchDistance tiles is generated in the background, FloorCacheSize floors stay in memory.
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FloorProperties) bool bMultiFloor;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FloorProperties, meta = (ClampMin = "0")) int32 PrefetchDistance;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FloorProperties, meta = (ClampMin = "1")) int32 FloorCacheSize;
+   UPROPERTY(VisibleAnywhere, Transient, BlueprintReadOnly, Category = FloorProperties) int32 CurrentFloor;
+
+   // Endless mode: the map is streamed in ChunkSize x ChunkSize chunks around the player instead of generating XSize x YSize tiles
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties) bool bEndless;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties, meta = (ClampMin = "8")) int32 ChunkSize;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties, meta = (ClampMin = "0")) int32 ChunkMargin;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties, meta = (ClampMin = "0")) int32 ChunkMaxFeatures;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties, meta = (ClampMin = "0")) int32 StreamRadius;
+   UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = EndlessProperties, meta = (ClampMin = "1")) int32 ChunksPerTick;
    
    UPROPERTY() TArray<UInstancedStaticMeshComponent*> InstancedStaticMeshComponents;
+   UPROPERTY() TArray<UInstancedStaticMeshComponent*> StreamedComponents;
+
+   // Duration of the last Build(), generation and instancing included
+   UPROPERTY(VisibleAnywhere, Transient, BlueprintReadOnly, Category = MapStats) float LastBuildMilliseconds;
 
    // Methods
+   // In endless mode edits outlive the chunk: an evicted chunk gets them again when it streams back in. Build() drops them.
    UFUNCTION(BlueprintCallable, Category = MapMethods) void SetCell(int32 x, int32 y, ETileType celltype);
    UFUNCTION(BlueprintCallable, Category = MapMethods) ETileType GetCell(int32 x, int32 y) const;
    UFUNCTION(BlueprintCallable, Category = MapMethods) void SetCells(int32 xStart, int32 yStart, int32 xEnd, int32 yEnd, ETileType cellType);
@@ -106,29 +142,345 @@ protected:
    UFUNCTION(BlueprintCallable, Category = MapMethods) void Build();
    UFUNCTION(BlueprintCallable, Category = MapMethods) void SetCellMeta(int32 x, int32 y, FTileMeta celltype);
    UFUNCTION(BlueprintCallable, Category = MapMethods) FTileMeta GetCellMeta(int32 x, int32 y) const;
+   UFUNCTION(BlueprintCallable, Category = MapMethods) void SetCellLayer(EDungeonLayer Layer, int32 x, int32 y, int32 Value);
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 GetCellLayer(EDungeonLayer Layer, int32 x, int32 y) const;
+
+   // Region graph of the generated map, empty unless bRecordGraph is set. Regions are rooms and corridors, -1 is no region
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 GetRegionCount() const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) FDungeonRegion GetRegion(int32 Region) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) TArray<FDungeonDoor> GetRegionDoors(int32 Region) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 FindRegion(int32 x, int32 y) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 GetStairsRegion(bool bDown) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) TArray<int32> GetRegionsWithinHops(int32 Region, int32 MaxHops, bool bRoomsOnly) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 FindFarthestRoom(int32 Region) const;
+
+   // Change generator inputs and rebuild, a generation still in flight is cancelled
+   UFUNCTION(BlueprintCallable, Category = MapMethods) void SetSeed(int32 NewSeed);
+   UFUNCTION(BlueprintCallable, Category = MapMethods) void SetSize(int32 NewXSize, int32 NewYSize);
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool IsGenerating() const;
+
+   // Settings that need Tick(), the actor only ticks while one of them is in use
+   UFUNCTION(BlueprintSetter) void SetPlayerFlowFields(bool bEnable);
+   UFUNCTION(BlueprintSetter) void SetEntityMeshes(const TArray<FTileMesh>& Meshes);
+
+   // Moves to another floor, an adjacent one is placed so that its stairs line up with the ones taken.
+   // Returns false without waiting while that floor is still generating in the background.
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool ChangeFloor(int32 Delta);
+
+   // Binary map files, see FDungeonMapFile. Loading replaces the map without generating, flat maps only
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool SaveMap(const FString& Filename) const;
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool LoadMap(const FString& Filename);
+
+   // Field of view of the player, only maintained with fog of war
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool IsTileVisible(int32 x, int32 y) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool IsTileExplored(int32 x, int32 y) const;
+
+   // Monsters, items and traps as pooled data instead of actors, see FDungeonEntities. Entities are cleared with the map
+   UFUNCTION(BlueprintCallable, Category = MapMethods) FDungeonEntityId SpawnEntity(EDungeonEntityKind Kind, int32 Type, const FIntPoint& Tile, int32 Speed);
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool DespawnEntity(const FDungeonEntityId& Id);
+   UFUNCTION(BlueprintCallable, Category = MapMethods) int32 SpawnRandomEntities(EDungeonEntityKind Kind, int32 Type, int32 Count, int32 Speed);
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool MoveEntity(const FDungeonEntityId& Id, const FIntPoint& Tile);
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool GetEntityTile(const FDungeonEntityId& Id, FIntPoint& OutTile) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) TArray<FDungeonEntityId> GetEntitiesAt(const FIntPoint& Tile) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 GetEntityCount() const;
+
+   // Runs the turns of every entity due within Duration, 100 is one action at speed 100. Monsters step along the
+   // "Player" flow field. Returns the number of turns taken
+   UFUNCTION(BlueprintCallable, Category = MapMethods) int32 AdvanceTurns(int32 Duration);
+
+   // Fired once the map is generated and its instances are built
+   UPROPERTY(BlueprintAssignable, Category = MapEvents) FOnDungeonReady OnDungeonReady;
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+   virtual void Serialize(FArchive& Ar) override;
+
+   // Grid pathfinding over walkable tiles, replaces navmesh queries on flat maps
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool CanFindPath() const;
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool FindPath(const FVector& From, const FVector& To, TArray<FVector>& OutPoints);
+   UFUNCTION(BlueprintPure, Category = MapMethods) FIntPoint WorldToTile(const FVector& Location) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) FVector TileToWorld(const FIntPoint& Tile) const;
+
+   // Flow fields shared by any number of agents, see FDungeonFlowField. A layer is computed once per goal change,
+   // reading the next step of an agent costs the same for one agent or hundreds. Radius 0 covers the whole map
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool UpdateFlowField(FName Layer, const TArray<FVector>& Goals, int32 Radius);
+   UFUNCTION(BlueprintCallable, Category = MapMethods) bool UpdateFleeField(FName Layer, FName From, float Coefficient);
+   UFUNCTION(BlueprintPure, Category = MapMethods) bool GetFlowStep(FName Layer, const FVector& From, FVector& OutTo) const;
+   UFUNCTION(BlueprintPure, Category = MapMethods) int32 GetFlowDistance(FName Layer, const FVector& At) const;
+
+   /** Computed flow field layer for agents in C++, nullptr if the layer has not been computed. */
+   const FDungeonFlowField* GetFlowField(FName Layer) const;
+
+   /** Entities of the current map for systems in C++. Call MarkEntitiesMoved() after moving them. */
+   FDungeonEntities& GetEntities() { return Entities_; }
+   void MarkEntitiesMoved() { bEntityVisualsDirty_ = true; }
+
+   /**
+    * Intersects a ray with the top faces of the wall and floor tiles without a physics trace. OutHit is
+    * filled like a blocking hit of a trace of MaxDistance along the ray, with the instanced component
+    * of the tile that was hit. Returns false where the ray does not end on a rendered tile within
+    * MaxDistance, callers fall back to a trace there.
+    */
+   bool IntersectTiles(const FVector& RayOrigin, const FVector& RayDirection, float MaxDistance, FHitResult& OutHit) const;
+
+   /** Bumped whenever tiles change, paths found on an older version may be stale. */
+   uint32 GetMapVersion() const { return MapVersion_; }
+
+   /**
+    * Instance transforms Build() computes for a generated map, without a world or meshes: every tile type is
+    * placed on a 100 unit grid and cut into ChunkTiles x ChunkTiles chunks. Used by the benchmark, returns the
+    * number of transforms.
+    */
+   static int32 ComputeBuildTransforms(const FDungeonGenerator& Generator, int32 ChunkTiles, bool bMergeWalls);
+
 #if WITH_EDITOR
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
 #endif // WITH_EDITOR
 
 private:
-   std::vector<ETileType> Data_;
-   std::vector<FTileMeta>  Meta_;
+   struct FStreamedChunk
+   {
+      FIntPoint Coord;
+      std::vector<ETileType> Cells;
+      TArray<UInstancedStaticMeshComponent*> Components;
+   };
+
+   /** Back buffer of an asynchronous generation. */
+   struct FGenerationJob
+   {
+      FGenerationJob() : bCancelled(false), GenerateSeconds(0.0) {}
+
+      FDungeonGenerator Generator;
+      std::atomic<bool> bCancelled;
+      double GenerateSeconds;
+   };
+
+   FDungeonGenerator Generator_;
+
+   // Generator_ holds a saved or loaded map that Build() shows instead of generating
+   bool bHasSavedMap_;
+
+   /** True once Generator_ holds a map, generated or loaded. */
+   bool HasMap() const { return MapVersion_ != 0 || bHasSavedMap_; }
+
+   // Walkable mask of Generator_, rebuilt on the first path query after a map change
+   FDungeonPathfinder Pathfinder_;
+   FDungeonBitGrid Walkable_;
+   std::vector<FIntPoint> PathTiles_;
+   uint32 MapVersion_;
+   uint32 WalkableVersion_;
 
-   RngT rnd_;
+   /** Brings Walkable_ up to date with Generator_. */
+   void UpdateWalkable();
 
+   // Fog of war state, recomputed when the player enters another tile or the map changes
+   FDungeonFieldOfView FieldOfView_;
+   std::vector<int32> NewlyExplored_;
+   FIntPoint ViewTile_;
+   uint32 ViewVersion_;
+   bool bFogActive_;
+
+   // Flow field layers by name and the player tile the player layers were computed for
+   TMap<FName, TUniquePtr<FDungeonFlowField>> FlowFields_;
+   std::vector<FIntPoint> FlowGoals_;
+   FIntPoint FlowTile_;
+   uint32 FlowVersion_;
+
+   FDungeonFlowField& FindOrAddFlowField(FName Layer);
+   void UpdatePlayerFlowFields();
+
+   void UpdateFieldOfView();
+
+   // Entities of the current map and one instanced mesh per EntityMeshes entry, refreshed on the next Tick() once dirty
+   FDungeonEntities Entities_;
+   UPROPERTY() TArray<UInstancedStaticMeshComponent*> EntityComponents_;
+   TArray<TArray<FTransform>> EntityTransforms_;
+   bool bEntityVisualsDirty_;
+   FIntPoint EntityViewTile_;
+   RngT EntityRng_;
+
+   /** Instances the entities the player can see, fog of war or not. */
+   void RefreshEntityVisuals();
+
+   /** Ticks only while something is updated per frame. */
+   void UpdateTickEnabled();
+
+   /** Component holding the instances of the tile type at a tile, null where there is none. */
+   UInstancedStaticMeshComponent* FindTileComponent(int32 x, int32 y, ETileType tile) const;
+
+   /** Tile as it is instanced, unexplored tiles are left out under fog of war. */
+   ETileType GetRenderedCell(int32 x, int32 y) const;
+
+   FDungeonChunkPlanner Planner_;
+   std::unordered_map<uint64, FStreamedChunk> Chunks_;
+
+   // SetCell() edits of endless chunks by chunk key, loaded or not, each keyed by the tile's index in its chunk
+   std::unordered_map<uint64, TMap<int32, ETileType>> ChunkEdits_;
+
+   // Job in flight, and the last finished one whose buffers are reused by the next run
+   TSharedPtr<FGenerationJob, ESPMode::ThreadSafe> Job_;
+   TSharedPtr<FGenerationJob, ESPMode::ThreadSafe> SpareJob_;
+
+   void ConfigureGenerator(FDungeonGenerator& Generator) const;
    void Generate();
-   int32 GetRandomInt(int32 min, int32 max);
-   EDirection GetRandomDirection();
-   bool MakeCorridor(int32 x, int32 y, int32 maxLength, EDirection direction);
-   bool MakeRoom(int32 x, int32 y, int32 xMaxLength, int32 yMaxLength, EDirection direction);
-   bool MakeFeature(int32 x, int32 y, int32 xmod, int32 ymod, EDirection direction);
-   bool MakeFeature();
-   bool MakeStairs(ETileType tile);
-   bool MakeDungeon();
-
-   UInstancedStaticMeshComponent* BuildInstancedMesh(ETileType tile);
+   void StartGeneration();
+   void CancelGeneration();
+   void FinishGeneration();
+
+   /** Builds the instances for Generator_ and announces the new map. */
+   void FinishBuild(double GenerateSeconds);
+
+   void UpdateStreaming(int32 Budget);
+   void LoadChunk(const FIntPoint& Coord);
+   void UnloadChunk(FStreamedChunk& Chunk);
+
+   /** Builds the instances of a streamed chunk from its cells, creating its components on the first call. */
+   void InstanceChunk(FStreamedChunk& Chunk);
+
+   /** Records an edit of an endless tile and applies it to its chunk if that is loaded, which is returned. */
+   FStreamedChunk* EditChunkCell(int32 x, int32 y, ETileType tile);
+   void UnloadAllChunks();
+   FStreamedChunk* FindChunk(int32 x, int32 y, int32& OutIndex);
+   const FStreamedChunk* FindChunk(int32 x, int32 y, int32& OutIndex) const;
+   FIntPoint GetStreamingFocusTile() const;
+   FVector GetStreamingFocusWorld() const;
+
+   /** Pushes the live instance count per tile type to the dungeon counters. */
+   void PublishInstanceCounts() const;
+
+   // One instanced mesh component per tile type starting at TE_DirtWall
+   static const int32 NumTileMeshes = 6;
+
+   /** Instance placement per tile type, mesh extents are read once per build rather than once per tile. */
+   struct FTileLayout
+   {
+      FVector Origin;
+      bool bPlaced[NumTileMeshes];
+      FVector2D Step[NumTileMeshes];
+
+      // Merged walls are not placed per tile, see ComputeMergedWalls(). Min is in mesh space, Size is scaled.
+      bool bMergeWalls;
+      FVector2D WallMin;
+      FVector2D WallSize;
+   };
+
+   // Tiles the pooled components currently show and the mapping between tiles and instances,
+   // used by Build() to only touch the instances of tiles that changed. CellOfInstance_ is indexed
+   // like InstancedStaticMeshComponents.
+   std::vector<ETileType> BuiltCells_;
+   std::vector<int32> InstanceOfCell_;
+   std::vector<std::vector<int32>> CellOfInstance_;
+   FTileLayout BuiltLayout_;
+   int32 BuiltXSize_;
+
+   // Merged walls by block, see ComputeMergedWalls(). Blocks are numbered chunk by chunk and row major
+   // within a chunk. WallBlockOfInstance_ maps the instances of every chunk's wall component back to
+   // their block, so a changed tile only re-merges the block around it.
+   std::vector<int32> FirstWallBlock_;
+   std::vector<std::vector<int32>> WallBlockInstances_;
+   std::vector<std::vector<int32>> WallBlockOfInstance_;
+
+   /** A floor generated ahead of time, or kept after leaving it. */
+   struct FFloor
+   {
+      FFloor() : Index(0), bCancelled(false), Origin(FVector::ZeroVector), LastUsed(0) {}
+
+      int32 Index;
+      FDungeonGenerator Generator;
+      std::atomic<bool> bCancelled;
+
+      // Actor location of the floor, puts its stairs under the ones that lead to it
+      FVector Origin;
+
+      // Instances of every pooled component computed with Layout, empty for floors kept after leaving them
+      FTileLayout Layout;
+      TArray<TArray<FTransform>> Transforms;
+      TArray<int32> WallBlockCounts;
+
+      TFuture<void> Task;
+      uint64 LastUsed;
+   };
+
+   // Floors other than the current one, least recently used are dropped beyond FloorCacheSize
+   TArray<TSharedPtr<FFloor, ESPMode::ThreadSafe>> Floors_;
+   uint64 FloorClock_;
+
+   // Stairs of the current floor, MAX_int32 if there are none. Stairs only lead on after the player left the ones they arrived on.
+   FIntPoint UpStairs_;
+   FIntPoint DownStairs_;
+   bool bStairsArmed_;
+
+   // Instances computed with a prefetched floor, consumed by the next RebuildInstances()
+   TArray<TArray<FTransform>> PrecomputedTransforms_;
+   TArray<int32> PrecomputedWallBlockCounts_;
+   FTileLayout PrecomputedLayout_;
+
+   void UpdateFloors();
+   TSharedPtr<FFloor, ESPMode::ThreadSafe> PrefetchFloor(int32 Index);
+   void ResetFloors();
+
+   // Chunk grid of InstancedStaticMeshComponents, a single chunk spans the map without hierarchical instancing
+   int32 InstanceChunkSize_;
+   int32 InstanceChunksX_;
+
+   void ClearInstancedMeshes();
+   void EnsureInstancedMeshes(const FTileLayout& Layout);
+
+   /** Index into InstancedStaticMeshComponents of the component holding the instance of a tile. */
+   int32 GetInstanceComponent(int32 cell, ETileType tile) const;
+   void GetInstanceChunkGrid(int32 MapXSize, int32 MapYSize, int32& OutChunkTiles, int32& OutChunksX, int32& OutChunksY) const;
+   void GetInstanceChunkRect(int32 Chunk, int32& OutX, int32& OutY, int32& OutWidth, int32& OutHeight) const;
+
+   /** Re-merges the wall blocks containing or bordering one of the given cells, instances of other blocks stay as they are. */
+   void UpdateMergedWalls(const FTileLayout& Layout, const std::vector<int32>& Changed);
+
+   /** Replaces the merged wall instances of one block with Transforms. */
+   void SetWallBlockInstances(int32 Chunk, int32 Block, const TArray<FTransform>& Transforms);
+
+   /** Rebuilds the wall block bookkeeping for wall components filled with the given instance count per block. */
+   void IndexMergedWalls(const TArray<int32>& BlockCounts);
+   int32 GetWallBlock(int32 x, int32 y) const;
+   void RebuildInstances(const FTileLayout& Layout);
+   bool UpdateInstances(const FTileLayout& Layout);
+
+   /** Moves, adds and removes instances for the given cells after their rendered tile changed. */
+   void ApplyInstanceChanges(const FTileLayout& Layout, const std::vector<int32>& Changed);
+   static bool IsSameLayout(const FTileLayout& A, const FTileLayout& B);
+   FVector GetTileSize() const;
+   FTileLayout MakeTileLayout() const;
+   static bool GetTileTransform(const FTileLayout& Layout, ETileType tile, int32 x, int32 y, FTransform& OutTransform);
+
+   /** Fills one transform array per tile type for the given tile rectangle, rows are processed in parallel. */
+   static void ComputeInstanceTransforms(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+      TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>* OutTransforms);
+
+   /**
+    * Transforms of every pooled component for a map cut into the given chunk grid, in component order.
+    * With merged walls OutWallBlockCounts gets the instance count of every wall block, chunk by chunk.
+    */
+   static void ComputeAllTransforms(const FTileLayout& Layout, int32 ChunkTiles, int32 ChunksX, int32 ChunksY, int32 MapXSize, int32 MapYSize,
+      TFunctionRef<ETileType(int32, int32)> GetTile, TArray<TArray<FTransform>>& OutTransforms, TArray<int32>& OutWallBlockCounts);
+
+   /**
+    * Merged walls of a rectangle, cut into blocks of MergeBlockTiles x MergeBlockTiles tiles that are merged
+    * on their own and emitted one after the other in row major order. OutBlockCounts, if given, gets the
+    * number of transforms of every block appended.
+    */
+   static void ComputeMergedWalls(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+      TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>& OutTransforms, TArray<int32>* OutBlockCounts = nullptr);
+
+   /**
+    * Greedy meshing of the wall tiles in a rectangle: each transform stretches the wall mesh over the widest
+    * run of walls and as many rows below it as the run continues. GetTile is also asked for the ring of tiles
+    * around the rectangle, walls without a walkable neighbour are left out. Transforms are appended.
+    */
+   static void AppendMergedWalls(const FTileLayout& Layout, int32 xOrigin, int32 yOrigin, int32 Width, int32 Height,
+      TFunctionRef<ETileType(int32, int32)> GetTile, TArray<FTransform>& OutTransforms);
+
+   /** Replaces all instances of a component with a single render, physics and navigation update. */
+   static void SetInstances(UInstancedStaticMeshComponent* Component, const TArray<FTransform>& Transforms);
+   const FTileMesh* GetTileMesh(ETileType tile) const;
+   void ApplyTileMesh(UInstancedStaticMeshComponent* Component, ETileType tile, const FTileLayout& Layout);
+   UInstancedStaticMeshComponent* BuildInstancedMesh(ETileType tile, const FTileLayout& Layout);
 };
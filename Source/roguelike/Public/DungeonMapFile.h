@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "Templates/UniquePtr.h"
+#include "DungeonTypes.h"
+
+class FDungeonGenerator;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Versioned binary dungeon map: the tile grid and its meta data, run length encoded per square chunk.
+ *
+ *   Header     Magic 'DGMF', uint16 Version, uint16 Flags, int32 XSize, YSize, ChunkSize, NumChunks,
+ *              uint32 PayloadSize, uint32 Reserved. All fields little endian.
+ *   Chunk ends NumChunks uint32 offsets into the payload, chunk i spans [end(i - 1), end(i)).
+ *   Payload    Per chunk in row major chunk order, its tiles in row major order as runs of
+ *              (LEB128 run length, cell byte). The cell byte is the tile type in the low nibble
+ *              and the meta direction in the high nibble.
+ *
+ * Chunks are independent, a reader can decode any of them without touching the others.
+ */
+class ROGUELIKE_API FDungeonMapFile
+{
+public:
+   static const uint32 Magic = 0x464D4744;
+   static const uint16 Version = 1;
+   static const int32 HeaderSize = 32;
+   static const int32 DefaultChunkSize = 64;
+
+   /** Encodes the grid and meta data of Generator, which must have been generated or loaded. */
+   static void Write(const FDungeonGenerator& Generator, std::vector<uint8>& Out, int32 ChunkSize = DefaultChunkSize);
+
+   static bool Save(const FDungeonGenerator& Generator, const FString& Filename);
+};
+
+/** Decodes an encoded map in place. Does not own the bytes, they have to outlive the reader. */
+class ROGUELIKE_API FDungeonMapReader
+{
+public:
+   FDungeonMapReader();
+
+   /** Validates header and chunk table, no tile is decoded yet. */
+   bool Open(const uint8* Data, int64 Size);
+   bool IsOpen() const { return Data_ != nullptr; }
+
+   int32 GetXSize() const { return XSize_; }
+   int32 GetYSize() const { return YSize_; }
+   int32 GetChunkSize() const { return ChunkSize_; }
+   int32 GetNumChunksX() const { return ChunksX_; }
+   int32 GetNumChunksY() const { return ChunksY_; }
+
+   /** Tile rectangle covered by a chunk, chunks on the right and bottom border may be smaller. */
+   FIntRect GetChunkRect(int32 ChunkX, int32 ChunkY) const;
+
+   /** Decodes a single chunk in row major order. Returns false if its data is corrupt. */
+   bool DecodeChunk(int32 ChunkX, int32 ChunkY, std::vector<ETileType>& OutCells, std::vector<FTileMeta>* OutMeta = nullptr) const;
+
+   /**
+    * Resizes Generator to the map and decodes every chunk into it, without running the algorithm.
+    * Eager on purpose: occupancy, path finding and field of view need the whole grid, not only the visible chunks.
+    * Switches Generator to FS_Rejection sampling, the anchor frontier is not rebuilt for loaded maps.
+    */
+   bool Decode(FDungeonGenerator& Generator) const;
+
+private:
+   /** Calls Run(x, y, Count, Cell) for every run of the chunk, split at row ends. */
+   template <typename FunctionType>
+   bool ForEachRun(int32 ChunkX, int32 ChunkY, FunctionType Run) const;
+
+   const uint8* Data_;
+   int64 Size_;
+   int32 XSize_;
+   int32 YSize_;
+   int32 ChunkSize_;
+   int32 ChunksX_;
+   int32 ChunksY_;
+   const uint8* ChunkEnds_;
+   const uint8* Payload_;
+   uint32 PayloadSize_;
+};
+
+/** A map file opened for reading, mapped into memory where the platform supports it and read otherwise. */
+class ROGUELIKE_API FDungeonMapFileView
+{
+public:
+   FDungeonMapFileView();
+   ~FDungeonMapFileView();
+
+   bool Open(const FString& Filename);
+   void Close();
+
+   const FDungeonMapReader& GetReader() const { return Reader_; }
+
+private:
+   TUniquePtr<IMappedFileHandle> Handle_;
+   TUniquePtr<IMappedFileRegion> Region_;
+   TArray<uint8> Bytes_;
+   FDungeonMapReader Reader_;
+};
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+
+#include "CoreMinimal.h"
+#include "DungeonBitGrid.h"
+
+/**
+ * Jump Point Search over a walkable bit grid, eight directions without cutting corners.
+ *
+ * Straight runs through rooms and corridors are skipped in one jump instead of pushing every tile
+ * on the open list. The returned path holds the start, the jump points and the goal. Consecutive
+ * points are joined by straight or diagonal lines that only cross walkable tiles.
+ * Search buffers are stamped per search rather than cleared, so repeated queries on the same map
+ * do not touch the whole grid.
+ */
+class ROGUELIKE_API FDungeonPathfinder
+{
+public:
+   FDungeonPathfinder();
+
+   bool FindPath(const FDungeonBitGrid& Walkable, const FIntPoint& Start, const FIntPoint& Goal, std::vector<FIntPoint>& OutPath);
+
+   /** Nodes taken off the open list by the last search. */
+   int32 GetLastExpanded() const { return LastExpanded_; }
+
+private:
+   struct FOpenNode
+   {
+      float F;
+      int32 Cell;
+
+      bool operator<(const FOpenNode& Other) const { return F > Other.F; }
+   };
+
+   bool IsWalkable(int32 x, int32 y) const
+   {
+      return x >= 0 && y >= 0 && x < XSize_ && y < YSize_ && Walkable_->Get(x, y);
+   }
+
+   /** Next jump point from (x, y) moving in (dx, dy), false if the run hits a wall. */
+   bool Jump(int32 x, int32 y, int32 dx, int32 dy, int32& OutX, int32& OutY) const;
+   bool JumpStraight(int32 x, int32 y, int32 dx, int32 dy, int32& OutX, int32& OutY) const;
+
+   void Visit(int32 Cell, int32 ParentCell, float G, float H);
+   float Heuristic(int32 x, int32 y) const;
+
+   const FDungeonBitGrid* Walkable_;
+   int32 XSize_;
+   int32 YSize_;
+   FIntPoint Goal_;
+
+   // Per cell search state, only valid where Stamp_ matches the current search.
+   std::vector<uint32> Stamp_;
+   std::vector<float> G_;
+   std::vector<int32> Parent_;
+   std::vector<bool> Closed_;
+   uint32 Search_;
+
+   std::vector<FOpenNode> Open_;
+   int32 LastExpanded_;
+};
@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// "stat Dungeon" shows the per frame view, cycle scopes also show up in profiler captures.
+DECLARE_STATS_GROUP(TEXT("Dungeon"), STATGROUP_Dungeon, STATCAT_Advanced);
+
+struct FDungeonStats;
+
+enum class EDungeonCounter : int32
+{
+   // Generation, published once per generator run
+   Generations,
+   FeaturesPlaced,
+   FeatureTries,
+   RejectedTile,
+   RejectedDoor,
+   RejectedBounds,
+   RejectedArea,
+   StairTries,
+   StairsMissing,
+
+   // Instancing, instance counts hold the value of the last build
+   Builds,
+   ChunksLoaded,
+   InstancesDirtWall,
+   InstancesDirtFloor,
+   InstancesCorridor,
+   InstancesDoor,
+   InstancesUpStairs,
+   InstancesDownStairs,
+
+   // Per tick code
+   PlayerTicks,
+   CharacterTicks,
+   CursorTraces,
+   CursorTileHits,
+   FloorChangeStalls,
+
+   // Accumulated wall time
+   GenerateMicroseconds,
+   InstancingMicroseconds,
+   PlayerTickMicroseconds,
+   CharacterTickMicroseconds,
+
+   Num
+};
+
+/**
+ * Session wide counters, safe to update from any thread. Each update is mirrored into
+ * STATGROUP_Dungeon. The console commands Dungeon.DumpCounters [File] and
+ * Dungeon.ResetCounters write them to CSV and clear them.
+ */
+class ROGUELIKE_API FDungeonCounters
+{
+public:
+   static void Add(EDungeonCounter Counter, int64 Value = 1);
+   static void Set(EDungeonCounter Counter, int64 Value);
+   static int64 Get(EDungeonCounter Counter);
+
+   /** Adds the counters of one finished generator run, bStairs is false for runs that never place stairs. */
+   static void AddGeneratorStats(const FDungeonStats& Stats, bool bStairs = true);
+
+   static void Reset();
+   static bool DumpCsv(const FString& FileName);
+
+   static const TCHAR* GetName(EDungeonCounter Counter);
+
+private:
+   static std::atomic<int64> Values[int32(EDungeonCounter::Num)];
+};
+
+/** Adds the wall time of the enclosing scope to a microsecond counter. */
+class FDungeonCounterTimer
+{
+public:
+   explicit FDungeonCounterTimer(EDungeonCounter InCounter)
+      : Counter(InCounter)
+      , StartCycles(FPlatformTime::Cycles64())
+   {
+   }
+
+   ~FDungeonCounterTimer()
+   {
+      FDungeonCounters::Add(Counter, int64(double(FPlatformTime::Cycles64() - StartCycles) * FPlatformTime::GetSecondsPerCycle64() * 1000000.0));
+   }
+
+private:
+   EDungeonCounter Counter;
+   uint64 StartCycles;
+};
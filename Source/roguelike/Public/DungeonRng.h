@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * PCG32 (XSH-RR) random stream, 16 bytes of state.
+ *
+ * Output and range reduction are fully specified here, so a (Seed, Stream) pair produces the same
+ * numbers on every platform and standard library. Streams with different ids are independent,
+ * which lets regions or features that run in parallel each draw from their own stream and still
+ * produce bit identical results regardless of scheduling.
+ */
+class FDungeonRng
+{
+public:
+   FDungeonRng()
+   {
+      SetSeed(0, 0);
+   }
+
+   FDungeonRng(uint64 Seed, uint64 Stream)
+   {
+      SetSeed(Seed, Stream);
+   }
+
+   void SetSeed(uint64 Seed, uint64 Stream)
+   {
+      // Stream ids are usually small consecutive numbers, mix them so the increments differ in all bits.
+      State_ = 0;
+      Inc_ = (Mix(Stream) << 1) | 1;
+      Next();
+      State_ += Mix(Seed);
+      Next();
+   }
+
+   uint32 Next()
+   {
+      const uint64 Old = State_;
+      State_ = Old * 6364136223846793005ull + Inc_;
+      const uint32 XorShifted = uint32(((Old >> 18) ^ Old) >> 27);
+      const uint32 Rot = uint32(Old >> 59);
+      return (XorShifted >> Rot) | (XorShifted << ((0u - Rot) & 31));
+   }
+
+   /** Uniform integer in [Min, Max], unbiased (Lemire's multiply and reject). Returns Min for an empty range. */
+   int32 Range(int32 Min, int32 Max)
+   {
+      if (Max <= Min)
+         return Min;
+
+      const uint32 Span = uint32(Max) - uint32(Min) + 1;
+      if (Span == 0)
+         return int32(Next());
+
+      uint64 Product = uint64(Next()) * Span;
+      uint32 Low = uint32(Product);
+
+      if (Low < Span)
+      {
+         const uint32 Threshold = (0u - Span) % Span;
+         while (Low < Threshold)
+         {
+            Product = uint64(Next()) * Span;
+            Low = uint32(Product);
+         }
+      }
+
+      return int32(uint32(Min) + uint32(Product >> 32));
+   }
+
+   /** splitmix64 finaliser, also used to hash coordinates into seeds and stream ids. */
+   static uint64 Mix(uint64 Value)
+   {
+      Value += 0x9e3779b97f4a7c15ull;
+      Value = (Value ^ (Value >> 30)) * 0xbf58476d1ce4e5b9ull;
+      Value = (Value ^ (Value >> 27)) * 0x94d049bb133111ebull;
+      return Value ^ (Value >> 31);
+   }
+
+private:
+   uint64 State_;
+   uint64 Inc_;
+};
@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonSweepCommandlet.generated.h"
+
+/**
+ * Runs the dungeon generator for a range of seeds on all cores without a world.
+ *
+ *   UE4Editor-Cmd roguelike.uproject -run=DungeonSweep -SeedStart=0 -SeedCount=10000 [-Algorithm=Accretion
+ *      -XSize=80 -YSize=25 -MaxFeatures=100 -ChanceRoom=75 -ChanceCorridor=25 -CaveIterations=5 -Rejection -BitPlanes
+ *      -Ascii -Png -Out=<dir>]
+ *
+ * Writes one CSV row of FDungeonStats per seed to <Out>/DungeonSweep.csv, -Ascii and -Png add a
+ * map dump per seed. Out defaults to Saved/DungeonSweep. Algorithm is one of Accretion, BSP, Drunkard
+ * and Cellular, the room, corridor and sampling options only steer accretion.
+ */
+UCLASS()
+class ROGUELIKE_API UDungeonSweepCommandlet : public UCommandlet
+{
+   GENERATED_BODY()
+
+public:
+   UDungeonSweepCommandlet();
+
+   virtual int32 Main(const FString& Params) override;
+};
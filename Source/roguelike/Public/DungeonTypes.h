@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonTypes.generated.h"
+
+UENUM(BlueprintType)
+enum class ETileType : uint8
+{
+   TE_Unused UMETA(DisplayName="Unused"),
+   TE_DirtWall UMETA(DisplayName="DirtWall"),
+   TE_DirtFloor UMETA(DisplayName="DirtFloor"),
+   TE_Corridor	UMETA(DisplayName="Corridor"),
+   TE_Door UMETA(DisplayName="Door"),
+   TE_UpStairs UMETA(DisplayName="UpStairs"),
+   TE_DownStairs UMETA(DisplayName="DownStairs")
+};
+
+UENUM(BlueprintType)
+enum class EDirection : uint8
+{
+   DE_North UMETA(DisplayName = "North"),
+   DE_South UMETA(DisplayName = "South"),
+   DE_East UMETA(DisplayName = "East"),
+   DE_West UMETA(DisplayName = "West"),
+   DE_NorthWest UMETA(DisplayName = "NorthWest"),
+   DE_NorthEast UMETA(DisplayName = "NorthEast"),
+   DE_SouthWest UMETA(DisplayName = "SouthWest"),
+   DE_SouthEast UMETA(DisplayName = "SouthEast")
+};
+
+// How MakeFeature() picks the tile a new feature is attached to
+UENUM(BlueprintType)
+enum class EFeatureSampling : uint8
+{
+   FS_Rejection UMETA(DisplayName = "Rejection", ToolTip = "Random tiles, most of them are rejected"),
+   FS_Frontier UMETA(DisplayName = "Frontier", ToolTip = "Random entry of the set of valid anchor tiles")
+};
+
+// Layout algorithm of FDungeonGenerator, see DungeonAlgorithms.h
+UENUM(BlueprintType)
+enum class EDungeonAlgorithm : uint8
+{
+   DA_Accretion UMETA(DisplayName = "Accretion", ToolTip = "Rooms and corridors grown from the walls of what is already built"),
+   DA_BSP UMETA(DisplayName = "BSP", ToolTip = "Binary space partition into cells with one room each, siblings joined by corridors"),
+   DA_Drunkard UMETA(DisplayName = "Drunkard's Walk", ToolTip = "Caverns carved by random walks"),
+   DA_Cellular UMETA(DisplayName = "Cellular Caves", ToolTip = "Random noise smoothed into caves by a cellular automaton")
+};
+
+// In memory layout of the tile grid
+UENUM(BlueprintType)
+enum class ETileStorage : uint8
+{
+   TS_Bytes UMETA(DisplayName = "Bytes", ToolTip = "One byte per tile"),
+   TS_BitPlanes UMETA(DisplayName = "Bit Planes", ToolTip = "Three bits per tile in three planes, walkability and adjacency masks are built from whole words")
+};
+
+// Per tile data layers, see FDungeonLayers
+UENUM(BlueprintType, meta = (Bitflags))
+enum class EDungeonLayer : uint8
+{
+   DL_Direction UMETA(DisplayName = "Direction"),
+   DL_RoomId UMETA(DisplayName = "Room Id"),
+   DL_RegionId UMETA(DisplayName = "Region Id"),
+   DL_EntranceDistance UMETA(DisplayName = "Entrance Distance"),
+   DL_Light UMETA(DisplayName = "Light"),
+   DL_Explored UMETA(DisplayName = "Explored")
+};
+
+USTRUCT(BlueprintType)
+struct FTileMeta
+{
+   GENERATED_BODY()
+   UPROPERTY(EditAnywhere) EDirection dir;
+};
+
+// A room or corridor placed by FDungeonGenerator, a node of FDungeonGraph
+USTRUCT(BlueprintType)
+struct FDungeonRegion
+{
+   GENERATED_BODY()
+
+   FDungeonRegion() : Min(0, 0), Max(0, 0), bRoom(false) {}
+   FDungeonRegion(const FIntPoint& InMin, const FIntPoint& InMax, bool bInRoom) : Min(InMin), Max(InMax), bRoom(bInRoom) {}
+
+   // Inclusive tile bounds, the walls of a room included. Bounds may overlap, e.g. where BSP corridors cross,
+   // a tile belongs to the first region containing it.
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) FIntPoint Min;
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) FIntPoint Max;
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) bool bRoom;
+
+   bool Contains(int32 x, int32 y) const { return x >= Min.X && x <= Max.X && y >= Min.Y && y <= Max.Y; }
+};
+
+// A door between two regions, an edge of FDungeonGraph
+USTRUCT(BlueprintType)
+struct FDungeonDoor
+{
+   GENERATED_BODY()
+
+   FDungeonDoor() : Tile(0, 0), From(-1), To(-1) {}
+   FDungeonDoor(const FIntPoint& InTile, int32 InFrom, int32 InTo) : Tile(InTile), From(InFrom), To(InTo) {}
+
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) FIntPoint Tile;
+   // The region the door was cut into and the one built behind it
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) int32 From;
+   UPROPERTY(EditAnywhere, BlueprintReadOnly) int32 To;
+};
+
+// What an entity of FDungeonEntities is
+UENUM(BlueprintType)
+enum class EDungeonEntityKind : uint8
+{
+   EK_Monster UMETA(DisplayName = "Monster"),
+   EK_Item UMETA(DisplayName = "Item"),
+   EK_Trap UMETA(DisplayName = "Trap")
+};
+
+// Id of an entity of FDungeonEntities, ids of despawned entities stay invalid when their slot is reused
+USTRUCT(BlueprintType)
+struct FDungeonEntityId
+{
+   GENERATED_BODY()
+
+   FDungeonEntityId() : Slot(-1), Generation(0) {}
+   FDungeonEntityId(int32 InSlot, int32 InGeneration) : Slot(InSlot), Generation(InGeneration) {}
+
+   UPROPERTY(BlueprintReadOnly) int32 Slot;
+   UPROPERTY(BlueprintReadOnly) int32 Generation;
+
+   bool operator==(const FDungeonEntityId& Other) const { return Slot == Other.Slot && Generation == Other.Generation; }
+};
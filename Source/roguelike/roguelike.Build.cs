@@ -9,5 +9,8 @@ public class roguelike : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+
+		// PNG dumps of the seed sweep commandlet
+		PrivateDependencyModuleNames.AddRange(new string[] { "ImageWrapper" });
 	}
 }
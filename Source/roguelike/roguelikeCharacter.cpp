@@ -10,6 +10,10 @@
 #include "GameFramework/SpringArmComponent.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Materials/Material.h"
+#include "roguelikePlayerController.h"
+#include "DungeonProfiling.h"
+
+DECLARE_CYCLE_STAT(TEXT("Character tick"), STAT_DungeonCharacterTick, STATGROUP_Dungeon);
 
 AroguelikeCharacter::AroguelikeCharacter()
 {
@@ -58,6 +62,10 @@ AroguelikeCharacter::AroguelikeCharacter()
 
 void AroguelikeCharacter::Tick(float DeltaSeconds)
 {
+	SCOPE_CYCLE_COUNTER(STAT_DungeonCharacterTick);
+	FDungeonCounterTimer Timer(EDungeonCounter::CharacterTickMicroseconds);
+	FDungeonCounters::Add(EDungeonCounter::CharacterTicks);
+
     Super::Tick(DeltaSeconds);
 
 	if (CursorToWorld != nullptr)
@@ -78,8 +86,17 @@ void AroguelikeCharacter::Tick(float DeltaSeconds)
 		}
 		else if (APlayerController* PC = Cast<APlayerController>(GetController()))
 		{
+			// Our controller shares the cursor hit of this frame with click to move.
 			FHitResult TraceHitResult;
-			PC->GetHitResultUnderCursor(ECC_Visibility, true, TraceHitResult);
+			if (AroguelikePlayerController* RoguelikePC = Cast<AroguelikePlayerController>(PC))
+			{
+				RoguelikePC->GetCursorHit(TraceHitResult);
+			}
+			else
+			{
+				FDungeonCounters::Add(EDungeonCounter::CursorTraces);
+				PC->GetHitResultUnderCursor(ECC_Visibility, true, TraceHitResult);
+			}
 			FVector CursorFV = TraceHitResult.ImpactNormal;
 			FRotator CursorR = CursorFV.Rotation();
 			CursorToWorld->SetWorldLocation(TraceHitResult.Location);
@@ -5,15 +5,31 @@
 #include "Runtime/Engine/Classes/Components/DecalComponent.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "roguelikeCharacter.h"
+#include "EngineUtils.h"
+#include "DungeonMapActor.h"
+#include "DungeonProfiling.h"
+
+DECLARE_CYCLE_STAT(TEXT("PlayerController tick"), STAT_DungeonPlayerTick, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("Cursor hit"), STAT_DungeonCursorHit, STATGROUP_Dungeon);
 
 AroguelikePlayerController::AroguelikePlayerController()
 {
 	bShowMouseCursor = true;
 	DefaultMouseCursor = EMouseCursor::Crosshairs;
+
+	PathIndex = 0;
+	PathGoalTile = FIntPoint(MAX_int32, MAX_int32);
+	PathMapVersion = 0;
+
+	CursorHitFrame = MAX_uint64;
 }
 
 void AroguelikePlayerController::PlayerTick(float DeltaTime)
 {
+	SCOPE_CYCLE_COUNTER(STAT_DungeonPlayerTick);
+	FDungeonCounterTimer Timer(EDungeonCounter::PlayerTickMicroseconds);
+	FDungeonCounters::Add(EDungeonCounter::PlayerTicks);
+
 	Super::PlayerTick(DeltaTime);
 
 	// keep updating the destination every tick while desired
@@ -21,6 +37,8 @@ void AroguelikePlayerController::PlayerTick(float DeltaTime)
 	{
 		MoveToMouseCursor();
 	}
+
+	FollowPath();
 }
 
 void AroguelikePlayerController::SetupInputComponent()
@@ -57,9 +75,9 @@ void AroguelikePlayerController::MoveToMouseCursor()
 	}
 	else
 	{
-		// Trace to see what is under the mouse cursor
+		// See what is under the mouse cursor
 		FHitResult Hit;
-		GetHitResultUnderCursor(ECC_Visibility, false, Hit);
+		GetCursorHit(Hit);
 
 		if (Hit.bBlockingHit)
 		{
@@ -69,6 +87,35 @@ void AroguelikePlayerController::MoveToMouseCursor()
 	}
 }
 
+bool AroguelikePlayerController::GetCursorHit(FHitResult& OutHit)
+{
+	if (CursorHitFrame != GFrameCounter)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_DungeonCursorHit);
+
+		CursorHitFrame = GFrameCounter;
+		CursorHit = FHitResult();
+
+		// Over the dungeon the view ray is intersected with the tile grid, only off-map cursors need a trace.
+		FVector RayOrigin;
+		FVector RayDirection;
+		ADungeonMapActor* Map = GetDungeonMap();
+
+		if (Map && DeprojectMousePositionToWorld(RayOrigin, RayDirection) && Map->IntersectTiles(RayOrigin, RayDirection, HitResultTraceDistance, CursorHit))
+		{
+			FDungeonCounters::Add(EDungeonCounter::CursorTileHits);
+		}
+		else
+		{
+			FDungeonCounters::Add(EDungeonCounter::CursorTraces);
+			GetHitResultUnderCursor(ECC_Visibility, true, CursorHit);
+		}
+	}
+
+	OutHit = CursorHit;
+	return CursorHit.bBlockingHit;
+}
+
 void AroguelikePlayerController::MoveToTouchLocation(const ETouchIndex::Type FingerIndex, const FVector Location)
 {
 	FVector2D ScreenSpaceLocation(Location);
@@ -91,6 +138,32 @@ void AroguelikePlayerController::SetNewMoveDestination(const FVector DestLocatio
 		UNavigationSystem* const NavSys = GetWorld()->GetNavigationSystem();
 		float const Distance = FVector::Dist(DestLocation, MyPawn->GetActorLocation());
 
+		// Dungeon maps are searched on their tile grid. While the button is held the destination
+		// usually stays on the same tile, so the path being followed to it is reused.
+		ADungeonMapActor* Map = GetDungeonMap();
+		if (Map && Map->CanFindPath())
+		{
+			const FIntPoint GoalTile = Map->WorldToTile(DestLocation);
+			if (GoalTile == PathGoalTile && Map->GetMapVersion() == PathMapVersion && PathPoints.IsValidIndex(PathIndex))
+			{
+				return;
+			}
+
+			if (Distance > 120.0f)
+			{
+				PathGoalTile = GoalTile;
+				PathMapVersion = Map->GetMapVersion();
+				PathIndex = 0;
+
+				// A failed search is not cached, the next click on the tile searches again.
+				if (!Map->FindPath(MyPawn->GetActorLocation(), DestLocation, PathPoints))
+				{
+					PathGoalTile = FIntPoint(MAX_int32, MAX_int32);
+				}
+			}
+			return;
+		}
+
 		// We need to issue move command only if far enough in order for walk animation to play correctly
 		if (NavSys && (Distance > 120.0f))
 		{
@@ -99,6 +172,74 @@ void AroguelikePlayerController::SetNewMoveDestination(const FVector DestLocatio
 	}
 }
 
+void AroguelikePlayerController::FollowPath()
+{
+	APawn* const MyPawn = GetPawn();
+	if (!MyPawn || !PathPoints.IsValidIndex(PathIndex))
+	{
+		return;
+	}
+
+	// Waypoints are tile centres, a waypoint counts as reached within a quarter tile.
+	ADungeonMapActor* Map = GetDungeonMap();
+	const float AcceptRadius = Map ? 0.25f * FMath::Max(1.0f, (Map->TileToWorld(FIntPoint(1, 0)) - Map->TileToWorld(FIntPoint(0, 0))).Size()) : 50.0f;
+
+	FVector Delta = PathPoints[PathIndex] - MyPawn->GetActorLocation();
+	Delta.Z = 0.0f;
+
+	if (Delta.Size() <= AcceptRadius && ++PathIndex == PathPoints.Num())
+	{
+		PathPoints.Reset();
+		return;
+	}
+
+	if (PathPoints.IsValidIndex(PathIndex))
+	{
+		Delta = PathPoints[PathIndex] - MyPawn->GetActorLocation();
+		MyPawn->AddMovementInput(Delta.GetSafeNormal2D());
+	}
+}
+
+ADungeonMapActor* AroguelikePlayerController::GetDungeonMap()
+{
+	// Runs every frame for the cursor, so a world without a dungeon is only searched once.
+	UWorld* World = GetWorld();
+	if (!DungeonMap.IsValid() && World && DungeonMapWorld.Get() != World)
+	{
+		if (UWorld* Previous = DungeonMapWorld.Get())
+		{
+			Previous->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		}
+
+		DungeonMapWorld = World;
+		ActorSpawnedHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &AroguelikePlayerController::OnActorSpawned));
+
+		TActorIterator<ADungeonMapActor> It(World);
+		DungeonMap = It ? *It : nullptr;
+	}
+
+	return DungeonMap.Get();
+}
+
+void AroguelikePlayerController::OnActorSpawned(AActor* Actor)
+{
+	if (!DungeonMap.IsValid())
+	{
+		DungeonMap = Cast<ADungeonMapActor>(Actor);
+	}
+}
+
+void AroguelikePlayerController::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UWorld* World = DungeonMapWorld.Get())
+	{
+		World->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+	}
+	DungeonMapWorld = nullptr;
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void AroguelikePlayerController::OnSetDestinationPressed()
 {
 	// set flag to keep updating destination until released
@@ -6,6 +6,8 @@
 #include "GameFramework/PlayerController.h"
 #include "roguelikePlayerController.generated.h"
 
+class ADungeonMapActor;
+
 UCLASS()
 class AroguelikePlayerController : public APlayerController
 {
@@ -14,11 +16,18 @@ class AroguelikePlayerController : public APlayerController
 public:
 	AroguelikePlayerController();
 
+	/**
+	 * Hit under the mouse cursor for the current frame, shared by click to move and the cursor decal.
+	 * Computed once per frame, analytically against the dungeon tiles where possible.
+	 */
+	bool GetCursorHit(FHitResult& OutHit);
+
 protected:
 	/** True if the controlled character should navigate to the mouse cursor. */
 	uint32 bMoveToMouseCursor : 1;
 
 	// Begin PlayerController interface
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void PlayerTick(float DeltaTime) override;
 	virtual void SetupInputComponent() override;
 	// End PlayerController interface
@@ -38,6 +47,29 @@ protected:
 	/** Input handlers for SetDestination action. */
 	void OnSetDestinationPressed();
 	void OnSetDestinationReleased();
+
+	/** Steers the pawn along PathPoints, called every tick. */
+	void FollowPath();
+
+	/**
+	 * Dungeon that provides grid paths, null if there is none in the world. The world is searched once,
+	 * dungeons spawned later are picked up as they spawn.
+	 */
+	ADungeonMapActor* GetDungeonMap();
+	void OnActorSpawned(AActor* Actor);
+
+	/** Grid path being followed. Reused until it is finished while the destination stays on the same tile of the same map version. */
+	TArray<FVector> PathPoints;
+	int32 PathIndex;
+	FIntPoint PathGoalTile;
+	uint32 PathMapVersion;
+
+	TWeakObjectPtr<ADungeonMapActor> DungeonMap;
+	TWeakObjectPtr<UWorld> DungeonMapWorld;
+	FDelegateHandle ActorSpawnedHandle;
+
+	FHitResult CursorHit;
+	uint64 CursorHitFrame;
 };
 
 